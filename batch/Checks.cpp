@@ -0,0 +1,741 @@
+#include "Checks.h"
+
+#include <iostream>
+#include <memory>
+#include <limits>
+#include <cmath>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+#include "Scene.h"
+#include "Joint.h"
+#include "Rigid.h"
+#include "Spring.h"
+#include "SparseKKT.h"
+#include "SE3.h"
+#include "EmbeddedRK.h"
+#include "QuadProgBox.h"
+#include "WrapSphere.h"
+#include "WrapCylinder.h"
+#include "WrapDoubleCylinder.h"
+#include "AllocationCounter.h"
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+// The base scene with the keys of a case written over it
+static json applyCase(const json &base, const json &c)
+{
+	json js = base;
+	for (auto it = c.begin(); it != c.end(); ++it) {
+		js[it.key()] = it.value();
+	}
+	js["isPlotEnergy"] = false;
+	return js;
+}
+
+int checkAllocations(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	if (!AllocationCounter::isEnabled()) {
+		cout << "allocations: skipped, build with COUNT_ALLOCATIONS" << endl;
+		return 0;
+	}
+	if (!AllocationCounter::isComplete()) {
+		cout << "allocations: only operator new is counted on this platform" << endl;
+	}
+	int warm_up = spec.count("warm_up") ? spec["warm_up"].get<int>() : 3;
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 20;
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, applyCase(base, c));
+		scene->tare();
+		for (int i = 0; i < warm_up; ++i) {
+			scene->step();
+		}
+		size_t count = 0;
+		for (int i = 0; i < num_steps; ++i) {
+			scene->step();
+			count += scene->getStepAllocations();
+		}
+		bool isOk = count == 0;
+		num_failed += isOk ? 0 : 1;
+		cout << "allocations " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << count << " in " << num_steps << " steps" << endl;
+	}
+	return num_failed;
+}
+
+int checkSpringRefresh(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+		js["spring_refresh_tol"] = 0.0;
+		auto ref = make_shared<Scene>();
+		ref->loadFromJson(RESOURCE_DIR, js);
+		ref->tare();
+
+		double err = 0.0;
+		for (int i = 0; i < num_steps; ++i) {
+			scene->step();
+			ref->step();
+			for (int j = 0; j < (int)ref->getJoints().size(); ++j) {
+				err = max(err, abs(scene->getJoints()[j]->getTheta() - ref->getJoints()[j]->getTheta()));
+			}
+		}
+		int num_refreshes = 0;
+		int num_spring_steps = 0;
+		for (const auto &spring : scene->getSprings()) {
+			num_refreshes += spring->getNumRefreshes();
+			num_spring_steps += spring->getNumSteps();
+		}
+		bool isOk = err <= tol && num_refreshes < num_spring_steps;
+		num_failed += isOk ? 0 : 1;
+		cout << "spring_refresh " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_refreshes << " refreshes in "
+			<< num_spring_steps << " spring steps, joint angle error " << err << endl;
+	}
+	return num_failed;
+}
+
+int checkInertiaCache(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, applyCase(base, c));
+		scene->tare();
+		const auto &joints = scene->getJoints();
+		const auto &springs = scene->getSprings();
+		int num_boxes = (int)joints.size() + 1;
+
+		VectorXd thetalist, theta_cache;
+		MatrixXd M, M_exact;
+		VectorXd f, f_exact;
+		int num_misses = -1;
+		int num_hits = 0;
+		double err = 0.0;		// largest relative error
+		double ratio = 0.0;		// largest relative error over |dtheta|^2
+		for (int i = 0; i < num_steps; ++i) {
+			scene->step();
+			Joint::getThetaVector(joints, thetalist);
+			int misses = 0;
+			for (const auto &spring : springs) {
+				misses += spring->getNumCacheMisses();
+			}
+			if (misses != num_misses) {
+				// Rebuilt in this step
+				num_misses = misses;
+				theta_cache = thetalist;
+			}
+			else {
+				num_hits++;
+			}
+
+			Spring::computeMassMatrix(springs, num_boxes, true, M);
+			Spring::computeGravity(springs, num_boxes, true, f);
+			M_exact.setZero(num_boxes - 1, num_boxes - 1);
+			f_exact.setZero(num_boxes - 1);
+			for (const auto &spring : springs) {
+				spring->addMomentMassMatrix(M_exact);
+				spring->addMomentGravity(f_exact);
+			}
+			double e = max((M - M_exact).norm() / M_exact.norm(), (f - f_exact).norm() / f_exact.norm());
+			double dtheta = (thetalist - theta_cache).lpNorm<Infinity>();
+			err = max(err, e);
+			if (dtheta > 0.0) {
+				ratio = max(ratio, e / (dtheta * dtheta));
+			}
+			else if (e > 1e-12) {
+				ratio = numeric_limits<double>::infinity();
+			}
+		}
+		bool isOk = num_hits > 0 && ratio <= tol;
+		num_failed += isOk ? 0 : 1;
+		cout << "inertia_cache " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_hits << " hits in "
+			<< num_steps << " steps, relative error " << err << ", " << ratio << " |dtheta|^2" << endl;
+	}
+	return num_failed;
+}
+
+int checkWrapIterations(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		js["isDoubleCylinder"] = true;
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+		js["wrap_tol"] = 0.0;
+		js["isWrapWarmStart"] = false;
+		auto ref = make_shared<Scene>();
+		ref->loadFromJson(RESOURCE_DIR, js);
+		ref->tare();
+
+		// The wraps do not feed back into the dynamics, so both scenes follow the same path
+		double err = 0.0;
+		int num_wrapped = 0;
+		int num_iters = 0;
+		int num_calls = 0;
+		for (int i = 0; i < num_steps; ++i) {
+			scene->step();
+			ref->step();
+			const auto &wraps = scene->getWrapDoubleCylinders();
+			const auto &wraps_ref = ref->getWrapDoubleCylinders();
+			for (int j = 0; j < (int)wraps.size(); ++j) {
+				err = max(err, abs(wraps[j]->getLength() - wraps_ref[j]->getLength()) / js["cylinder_radius"].get<double>());
+				// Both cylinders wrapped, the only case that iterates
+				num_wrapped += wraps_ref[j]->get_status_u() == wrap && wraps_ref[j]->get_status_v() == wrap ? 1 : 0;
+				num_iters += wraps[j]->getNumIterations();
+				num_calls++;
+			}
+		}
+		bool isOk = err <= tol && num_wrapped > 0;
+		num_failed += isOk ? 0 : 1;
+		cout << "wrap_iterations " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_wrapped << " of " << num_calls
+			<< " on both cylinders, " << (double)num_iters / max(num_calls, 1) << " iterations per call, length error " << err << " radius" << endl;
+	}
+	return num_failed;
+}
+
+// Largest difference of the outputs of compute() between two lists of the same obstacles, and
+// the number of them that wrapped in both
+template <typename Wrap>
+static double compareWraps(const vector<shared_ptr<Wrap>> &wraps, const vector<shared_ptr<Wrap>> &wraps_ref, int &num_wrapped, int &num_status)
+{
+	double err = 0.0;
+	for (int j = 0; j < (int)wraps.size(); ++j) {
+		double R = abs(wraps_ref[j]->getRadius());
+		if (wraps[j]->getStatus() != wraps_ref[j]->getStatus()) {
+			num_status++;
+			continue;
+		}
+		err = max(err, abs(wraps[j]->getTotalLength() - wraps_ref[j]->getTotalLength()) / R);
+		if (wraps_ref[j]->getStatus() == wrap) {
+			err = max(err, abs(wraps[j]->getLength() - wraps_ref[j]->getLength()) / R);
+			err = max(err, abs(wraps[j]->getWrapMargin() - wraps_ref[j]->getWrapMargin()));
+			num_wrapped++;
+		}
+	}
+	return err;
+}
+
+int checkWrapBatch(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		js["isWrapBatch"] = true;
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+		js["isWrapBatch"] = false;
+		auto ref = make_shared<Scene>();
+		ref->loadFromJson(RESOURCE_DIR, js);
+		ref->tare();
+
+		// The wraps do not feed back into the dynamics, so both scenes follow the same path
+		double err = 0.0;
+		int num_wrapped = 0;
+		int num_status = 0;
+		for (int i = 0; i < num_steps; ++i) {
+			scene->step();
+			ref->step();
+			err = max(err, compareWraps(scene->getWrapSpheres(), ref->getWrapSpheres(), num_wrapped, num_status));
+			err = max(err, compareWraps(scene->getWrapCylinders(), ref->getWrapCylinders(), num_wrapped, num_status));
+		}
+		bool isOk = err <= tol && num_status == 0 && num_wrapped > 0;
+		num_failed += isOk ? 0 : 1;
+		cout << "wrap_batch " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_wrapped << " wrapped, "
+			<< num_status << " status mismatches, error " << err << " radius" << endl;
+	}
+	return num_failed;
+}
+
+// [M G^T; G 0] of the current poses. G holds the 6 rows that fix box 0 and, per joint, the
+// components of the relative twist in the joint frame that the revolute joint does not allow,
+// all but the rotation about z.
+static void computeDenseKKT(const vector<shared_ptr<Rigid>> &boxes, const vector<shared_ptr<Spring>> &springs, MatrixXd &K)
+{
+	int nb = 6 * (int)boxes.size();
+	int n = nb + 6 + 5 * ((int)boxes.size() - 1);
+	K.setZero(n, n);
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		K.block<6, 6>(6 * i, 6 * i) = boxes[i]->getMassMatrix();
+	}
+	for (int k = 0; k < (int)springs.size(); ++k) {
+		Matrix12d M_ii;
+		springs[k]->computeBoxMassMatrix(M_ii);
+		Vector2d box_id = springs[k]->getBoxID();
+		for (int a = 0; a < 2; ++a) {
+			for (int b = 0; b < 2; ++b) {
+				K.block<6, 6>(6 * (int)box_id(a), 6 * (int)box_id(b)) += M_ii.block<6, 6>(6 * a, 6 * b);
+			}
+		}
+	}
+
+	MatrixXd G = MatrixXd::Zero(n - nb, nb);
+	G.block<6, 6>(0, 0).setIdentity();
+	int rows[5] = { 0, 1, 3, 4, 5 };
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		auto joint = boxes[i]->getJoint();
+		Matrix6d Ad_P = Rigid::adjoint(joint->getE_P_J().inverse());
+		Matrix6d Ad_C = Rigid::adjoint(joint->getE_C_J().inverse());
+		int ip = 6 * boxes[i]->getParent()->getIndex();
+		int ic = 6 * boxes[i]->getIndex();
+		for (int r = 0; r < 5; ++r) {
+			G.block<1, 6>(6 + 5 * (i - 1) + r, ip) = Ad_P.row(rows[r]);
+			G.block<1, 6>(6 + 5 * (i - 1) + r, ic) = -Ad_C.row(rows[r]);
+		}
+	}
+	K.bottomLeftCorner(n - nb, nb) = G;
+	K.topRightCorner(nb, n - nb) = G.transpose();
+}
+
+int checkSparseKKT(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	int interval = spec.count("interval") ? spec["interval"].get<int>() : 50;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		js["isReduced"] = false;
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+
+		// A separate instance, so the pattern is analyzed on the first solve and reused after
+		SparseKKT kkt(scene->getBoxes(), scene->getSprings());
+		vector<Matrix12d> M_springs(scene->getSprings().size());
+		MatrixXd K;
+		VectorXd x;
+		double err = 0.0;
+		int num_solves = 0;
+		for (int i = 0; i <= num_steps; ++i) {
+			if (i % interval == 0) {
+				for (int k = 0; k < (int)M_springs.size(); ++k) {
+					scene->getSprings()[k]->computeBoxMassMatrix(M_springs[k]);
+				}
+				kkt.assemble(M_springs);
+				VectorXd b = VectorXd::Random(kkt.getSize());
+				kkt.solve(b, x);
+				computeDenseKKT(scene->getBoxes(), scene->getSprings(), K);
+				VectorXd x_ref = K.fullPivLu().solve(b);
+				err = max(err, (x - x_ref).norm() / x_ref.norm());
+				num_solves++;
+			}
+			scene->step();
+		}
+		bool isOk = err <= tol;
+		num_failed += isOk ? 0 : 1;
+		cout << "sparse_kkt " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_solves << " solves of size "
+			<< kkt.getSize() << ", relative error " << err << endl;
+	}
+	return num_failed;
+}
+
+// exp(X) by halving X until its norm is below 1/2, summing the Taylor series to 20 terms and
+// squaring back
+static Matrix4d expSeries(const Matrix4d &X)
+{
+	int num_squarings = 0;
+	double scale = 1.0;
+	while (X.norm() * scale > 0.5) {
+		scale *= 0.5;
+		num_squarings++;
+	}
+	Matrix4d term = Matrix4d::Identity();
+	Matrix4d E = Matrix4d::Identity();
+	for (int k = 1; k <= 20; ++k) {
+		term = term * (scale * X) / k;
+		E += term;
+	}
+	for (int k = 0; k < num_squarings; ++k) {
+		E = E * E;
+	}
+	return E;
+}
+
+int checkSE3(const string &, const json &, const json &spec)
+{
+	int num_samples = spec.count("num_samples") ? spec["num_samples"].get<int>() : 200;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		double min_angle = c["min_angle"];
+		double max_angle = c["max_angle"];
+		double exp_err = 0.0;
+		double log_err = 0.0;
+		for (int k = 0; k < num_samples; ++k) {
+			double t = min_angle * pow(max_angle / min_angle, (double)k / max(num_samples - 1, 1));
+			Vector6d xi;
+			xi.segment<3>(0) = t * Vector3d::Random().normalized();
+			xi.segment<3>(3) = Vector3d::Random().normalized();
+			Matrix4d E = SE3::exp(xi);
+			exp_err = max(exp_err, (E - expSeries(SE3::bracket6(xi))).cwiseAbs().maxCoeff());
+			log_err = max(log_err, (SE3::log(E) - xi).norm() / xi.norm());
+		}
+		bool isOk = exp_err <= tol && log_err <= tol;
+		num_failed += isOk ? 0 : 1;
+		cout << "se3 " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", exp error " << exp_err
+			<< ", log relative error " << log_err << endl;
+	}
+	return num_failed;
+}
+
+// y0' = cos(t) y0 and y1' = -2 t y1^2, solved by exp(sin(t)) and 1 / (1 + t^2) from [1; 1]
+struct OrderTestRHS
+{
+	void operator()(double t, const VectorXd &y, VectorXd &yp)
+	{
+		yp(0) = cos(t) * y(0);
+		yp(1) = -2.0 * t * y(1) * y(1);
+	}
+
+	static Vector2d solution(double t)
+	{
+		return Vector2d(std::exp(sin(t)), 1.0 / (1.0 + t * t));
+	}
+};
+
+// Largest error at t = 1 and at the step midpoints of num_steps fixed steps
+static void integrateFixed(int num_steps, double &err, double &dense_err)
+{
+	OrderTestRHS f;
+	EmbeddedRK<OrderTestRHS> rk(f, 2);
+	double h = 1.0 / num_steps;
+	// With h_min = h_max every step is taken at h and accepted
+	rk.setStepLimits(h, h);
+	rk.init(0.0, OrderTestRHS::solution(0.0));
+	VectorXd y_mid(2);
+	dense_err = 0.0;
+	for (int i = 0; i < num_steps; ++i) {
+		double t0 = rk.getTime();
+		rk.step();
+		double t_mid = 0.5 * (t0 + rk.getTime());
+		rk.interpolate(t_mid, y_mid);
+		dense_err = max(dense_err, (y_mid - OrderTestRHS::solution(t_mid)).cwiseAbs().maxCoeff());
+	}
+	err = (rk.getY() - OrderTestRHS::solution(rk.getTime())).cwiseAbs().maxCoeff();
+}
+
+int checkRKF45Order(const string &, const json &, const json &spec)
+{
+	double min_order = spec["min_order"];
+	double min_dense_order = spec["min_dense_order"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		int num_steps = c["num_steps"];
+		double err, dense_err, err2, dense_err2;
+		integrateFixed(num_steps, err, dense_err);
+		integrateFixed(2 * num_steps, err2, dense_err2);
+		double order = log2(err / err2);
+		double dense_order = log2(dense_err / dense_err2);
+		bool isOk = order >= min_order && dense_order >= min_dense_order;
+		num_failed += isOk ? 0 : 1;
+		cout << "rkf45_order " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", order " << order << " (error " << err
+			<< "), dense output order " << dense_order << " (error " << dense_err << ")" << endl;
+	}
+	return num_failed;
+}
+
+// Poses, spring endpoints and their Jacobians at the current joint angles
+static void updateKinematics(const shared_ptr<Scene> &scene)
+{
+	for (const auto &box : scene->getBoxes()) {
+		box->step(0.0);
+	}
+	for (const auto &spring : scene->getSprings()) {
+		spring->step(scene->getJoints());
+	}
+}
+
+int checkSpringStiffness(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	int interval = spec.count("interval") ? spec["interval"].get<int>() : 50;
+	double h = spec.count("h") ? spec["h"].get<double>() : 1e-6;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		js["isReduced"] = true;
+		js["isElastic"] = true;
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+		const auto &joints = scene->getJoints();
+		const auto &springs = scene->getSprings();
+		int num_boxes = (int)scene->getBoxes().size();
+		int n = (int)joints.size();
+		double E = js["stiffness"];
+
+		double err = 0.0;
+		double K_max = 0.0;
+		int num_samples = 0;
+		MatrixXd K, K_fd(n, n);
+		VectorXd f1, f0;
+		for (int i = 0; i <= num_steps; ++i) {
+			if (i % interval == 0) {
+				updateKinematics(scene);
+				Spring::computeStiffnessMatrix(springs, num_boxes, K);
+				for (int j = 0; j < n; ++j) {
+					double theta = joints[j]->getTheta();
+					joints[j]->setTheta(theta + h);
+					updateKinematics(scene);
+					Spring::computeElasticForce(springs, num_boxes, true, f1);
+					joints[j]->setTheta(theta - h);
+					updateKinematics(scene);
+					Spring::computeElasticForce(springs, num_boxes, true, f0);
+					joints[j]->setTheta(theta);
+					K_fd.col(j) = -(f1 - f0) / (2.0 * h);
+				}
+				updateKinematics(scene);
+				err = max(err, (K - K_fd).cwiseAbs().maxCoeff() / E);
+				K_max = max(K_max, K.cwiseAbs().maxCoeff() / E);
+				num_samples++;
+			}
+			scene->step();
+		}
+		bool isOk = err <= tol;
+		num_failed += isOk ? 0 : 1;
+		cout << "spring_stiffness " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_samples << " poses, largest K "
+			<< K_max << " stiffness, error " << err << " stiffness" << endl;
+	}
+	return num_failed;
+}
+
+// Largest violation of the KKT conditions of min 1/2 x^T H x + c^T x, l <= x <= u at x. The
+// gradient must vanish on free variables and point into the box on the bounds.
+static double computeKKTError(const MatrixXd &H, const VectorXd &c, const VectorXd &l, const VectorXd &u, const VectorXd &x, double tol)
+{
+	VectorXd g = H * x + c;
+	double err = 0.0;
+	for (int i = 0; i < (int)x.size(); ++i) {
+		err = max(err, max(l(i) - x(i), x(i) - u(i)));
+		if (x(i) <= l(i) + tol) {
+			err = max(err, -g(i));
+		}
+		else if (x(i) >= u(i) - tol) {
+			err = max(err, g(i));
+		}
+		else {
+			err = max(err, abs(g(i)));
+		}
+	}
+	return err;
+}
+
+// Minimizer over every assignment of free, lower and upper to the variables
+static VectorXd solveBoxQPBruteForce(const MatrixXd &H, const VectorXd &c, const VectorXd &l, const VectorXd &u)
+{
+	int n = (int)c.size();
+	int num_sets = 1;
+	for (int i = 0; i < n; ++i) {
+		num_sets *= 3;
+	}
+	double f_best = numeric_limits<double>::infinity();
+	VectorXd x_best = VectorXd::Zero(n);
+	VectorXd x(n);
+	for (int set = 0; set < num_sets; ++set) {
+		vector<int> free_idx;
+		bool isValid = true;
+		for (int i = 0, code = set; i < n; ++i, code /= 3) {
+			if (code % 3 == 0) {
+				free_idx.push_back(i);
+				x(i) = 0.0;
+			}
+			else {
+				x(i) = code % 3 == 1 ? l(i) : u(i);
+				isValid = isValid && isfinite(x(i));
+			}
+		}
+		if (!isValid) {
+			continue;
+		}
+		int nf = (int)free_idx.size();
+		MatrixXd H_FF(nf, nf);
+		VectorXd r_F(nf);
+		VectorXd g = H * x + c;
+		for (int a = 0; a < nf; ++a) {
+			r_F(a) = -g(free_idx[a]);
+			for (int b = 0; b < nf; ++b) {
+				H_FF(a, b) = H(free_idx[a], free_idx[b]);
+			}
+		}
+		VectorXd x_F = H_FF.ldlt().solve(r_F);
+		for (int a = 0; a < nf; ++a) {
+			x(free_idx[a]) = x_F(a);
+		}
+		if (((x - l).minCoeff() < 0.0) || ((u - x).minCoeff() < 0.0)) {
+			continue;
+		}
+		double f = 0.5 * x.dot(H * x) + c.dot(x);
+		if (f < f_best) {
+			f_best = f;
+			x_best = x;
+		}
+	}
+	return x_best;
+}
+
+int checkBoxQP(const string &, const json &, const json &spec)
+{
+	int num_problems = spec.count("num_problems") ? spec["num_problems"].get<int>() : 100;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		int n = c["num_vars"];
+		QuadProgBox qp;
+		qp.setNumberOfVariables(n);
+		MatrixXd A = MatrixXd::Random(n, n);
+		VectorXd q = VectorXd::Random(n);
+		VectorXd l = -VectorXd::Random(n).cwiseAbs();
+		VectorXd u = VectorXd::Random(n).cwiseAbs();
+		for (int i = 0; i < n; i += 4) {
+			l(i) = -numeric_limits<double>::infinity();
+		}
+		for (int i = 2; i < n; i += 4) {
+			u(i) = numeric_limits<double>::infinity();
+		}
+
+		double kkt_err = 0.0;
+		double bf_err = 0.0;
+		int num_solved = 0;
+		int num_iters = 0;
+		int num_active = 0;
+		for (int k = 0; k < num_problems; ++k) {
+			A += 0.1 * MatrixXd::Random(n, n);
+			q += 0.2 * VectorXd::Random(n);
+			MatrixXd H = A * A.transpose() + 0.1 * MatrixXd::Identity(n, n);
+			VectorXd cq = 2.0 * q;
+			qp.setObjectiveMatrix(H);
+			qp.setObjectiveVector(cq);
+			qp.setLowerVariableBound(l);
+			qp.setUpperVariableBound(u);
+			if (!qp.solve()) {
+				continue;
+			}
+			num_solved++;
+			num_iters += qp.getNumIterations();
+			VectorXd x = qp.getPrimalSolution();
+			for (int i = 0; i < n; ++i) {
+				num_active += x(i) == l(i) || x(i) == u(i) ? 1 : 0;
+			}
+			kkt_err = max(kkt_err, computeKKTError(H, cq, l, u, x, tol));
+			if (n <= 6) {
+				bf_err = max(bf_err, (x - solveBoxQPBruteForce(H, cq, l, u)).cwiseAbs().maxCoeff());
+			}
+		}
+		bool isOk = num_solved == num_problems && kkt_err <= tol && bf_err <= tol;
+		num_failed += isOk ? 0 : 1;
+		cout << "box_qp " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", " << num_solved << " of " << num_problems << " solved, "
+			<< (double)num_active / max(num_solved, 1) << " bounds active and " << (double)num_iters / max(num_solved, 1)
+			<< " iterations per solve, KKT error " << kkt_err << ", brute force error " << bf_err << endl;
+	}
+	return num_failed;
+}
+
+// Which surfaces the path wraps, compared between the samples of a difference
+static int getWrapState(const WrapObst &obst) { return obst.getStatus(); }
+static int getWrapState(const WrapDoubleCylinder &obst) { return 4 * obst.get_status_u() + obst.get_status_v(); }
+
+// Largest derivative error of the obstacles of one type at the current pose, and of their
+// moment arms
+template <typename Wrap>
+static void compareWrapDerivatives(const shared_ptr<Scene> &scene, const vector<shared_ptr<Wrap>> &wraps, double h,
+	double &err, double &arm_err, int &num_arms)
+{
+	const auto &joints = scene->getJoints();
+	const auto &boxes = scene->getBoxes();
+	int n = (int)joints.size();
+	for (const auto &obst : wraps) {
+		err = max(err, obst->checkDerivatives(h));
+		VectorXd arms = obst->computeMomentArms(n);
+		int state = getWrapState(*obst);
+		for (int j = 0; j < n; ++j) {
+			double theta = joints[j]->getTheta();
+			double L[2];
+			bool isSmooth = true;
+			for (int s = 0; s < 2; ++s) {
+				joints[j]->setTheta(theta + (s == 0 ? h : -h));
+				for (const auto &box : boxes) {
+					box->step(0.0);
+				}
+				L[s] = obst->getTotalLength();
+				isSmooth = isSmooth && getWrapState(*obst) == state;
+			}
+			joints[j]->setTheta(theta);
+			for (const auto &box : boxes) {
+				box->step(0.0);
+			}
+			if (isSmooth) {
+				arm_err = max(arm_err, abs(arms(j) + (L[0] - L[1]) / (2.0 * h)));
+				num_arms++;
+			}
+		}
+	}
+}
+
+int checkWrapDerivatives(const string &RESOURCE_DIR, const json &base, const json &spec)
+{
+	int num_steps = spec.count("num_steps") ? spec["num_steps"].get<int>() : 500;
+	int interval = spec.count("interval") ? spec["interval"].get<int>() : 25;
+	double h = spec.count("h") ? spec["h"].get<double>() : 1e-6;
+	double tol = spec["tol"];
+
+	int num_failed = 0;
+	for (const auto &c : spec["cases"]) {
+		json js = applyCase(base, c);
+		js["isSphere"] = true;
+		js["isCylinder"] = true;
+		js["isDoubleCylinder"] = true;
+		js["isWrapDerivatives"] = true;
+		js["isCheckWrapDerivatives"] = false;
+		js["wrap_tol"] = 0.0;
+		auto scene = make_shared<Scene>();
+		scene->loadFromJson(RESOURCE_DIR, js);
+		scene->tare();
+
+		double err = 0.0;
+		double arm_err = 0.0;
+		int num_arms = 0;
+		for (int i = 1; i <= num_steps; ++i) {
+			scene->step();
+			if (i % interval == 0) {
+				compareWrapDerivatives(scene, scene->getWrapSpheres(), h, err, arm_err, num_arms);
+				compareWrapDerivatives(scene, scene->getWrapCylinders(), h, err, arm_err, num_arms);
+				compareWrapDerivatives(scene, scene->getWrapDoubleCylinders(), h, err, arm_err, num_arms);
+			}
+		}
+		bool isOk = err <= tol && arm_err <= tol && num_arms > 0;
+		num_failed += isOk ? 0 : 1;
+		cout << "wrap_derivatives " << c.dump() << ": " << (isOk ? "ok" : "FAILED") << ", input derivative error " << err
+			<< ", moment arm error " << arm_err << " over " << num_arms << " arms" << endl;
+	}
+	return num_failed;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef MUSCLEMASS_BATCH_CHECKS_H_
+#define MUSCLEMASS_BATCH_CHECKS_H_
+#include <string>
+
+#include <json.hpp>
+
+// Self-checks of the numerical pieces, run by the batch runner on a file with a "check"
+// entry (see resources/check.json). Every check takes the base scene JSON and its own entry
+// of "check", prints one line per case and returns the number of cases that failed.
+
+// Steps each case (the base scene with the case's keys written in) past a warm-up and
+// fails if any later step allocates. Skipped unless built with COUNT_ALLOCATIONS.
+//     "allocations": { "warm_up": 3, "num_steps": 20, "cases": [ {}, { "isReduced": false } ] }
+int checkAllocations(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case with its "spring_refresh_tol" and again refreshing the spring samples every
+// step. Fails if the joint angles part by more than tol or if every step refreshed anyway.
+//     "spring_refresh": { "num_steps": 500, "tol": 1e-6, "cases": [ { "spring_refresh_tol": 1e-3 } ] }
+int checkSpringRefresh(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case with the spring inertia cache on and compares the Taylor estimate of the
+// reduced spring inertia and gravity with the exact moment sums at every step. Fails if a
+// relative error exceeds tol |dtheta|^2, dtheta the joint angle change since the cache was
+// rebuilt, or if the cache was never hit.
+//     "inertia_cache": { "num_steps": 500, "tol": 1.0, "cases": [ { "spring_cache_tol": 0.05 } ] }
+int checkInertiaCache(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case against the same scene with "wrap_tol" 0, which runs "wrap_max_iters" plain
+// double cylinder iterations from a cold start. Fails if a path length differs by more than
+// tol * radius, or if no step wrapped around both cylinders.
+//     "wrap_iterations": { "num_steps": 1000, "tol": 1e-8, "cases": [ { "isWrapWarmStart": true } ] }
+int checkWrapIterations(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case with the spheres and cylinders solved by the batch kernel next to the same
+// scene solving them one by one. Fails if a length or wrap margin differs by more than
+// tol * radius, if a status differs, or if nothing wrapped.
+//     "wrap_batch": { "num_steps": 500, "tol": 1e-12, "cases": [ { "isSphere": true, "isCylinder": true } ] }
+int checkWrapBatch(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case in maximal coordinates and every interval steps solves the KKT system of
+// the current poses with SparseKKT and densely, without the augmented term or the elimination
+// order, for a random right-hand side. Fails if the relative difference exceeds tol.
+//     "sparse_kkt": { "num_steps": 500, "interval": 50, "tol": 1e-9, "cases": [ {} ] }
+int checkSparseKKT(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// For rotation angles spread log-uniformly over each case's range, with random axes and
+// unit translations, compares SE3::exp() with a scaled and squared Taylor series of the
+// matrix exponential, and SE3::log(SE3::exp(xi)) with xi. Fails if the largest difference,
+// relative to |xi| for the log, exceeds tol.
+//     "se3": { "num_samples": 200, "tol": 1e-13, "cases": [ { "min_angle": 1e-8, "max_angle": 3.0 } ] }
+int checkSE3(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Integrates y' = cos(t) y and y' = -2 t y^2 from 0 to 1 with EmbeddedRK at fixed steps,
+// num_steps of them and twice as many, and measures the order of the solution at t = 1 and of
+// the dense output at the step midpoints from the exact solutions. A wrong Fehlberg
+// coefficient breaks an order condition. Fails below min_order or min_dense_order.
+//     "rkf45_order": { "min_order": 4.8, "min_dense_order": 3.8, "cases": [ { "num_steps": 8 } ] }
+int checkRKF45Order(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case with elastic springs in reduced coordinates and every interval steps
+// compares the spring stiffness K = d^2 V_e / dtheta^2 with central differences of the
+// elastic force, -d f_e / dtheta. Fails if the difference exceeds tol times the spring
+// constant "stiffness".
+//     "spring_stiffness": { "num_steps": 500, "interval": 50, "h": 1e-6, "tol": 1e-8, "cases": [ {} ] }
+int checkSpringStiffness(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Solves num_problems random box QPs of each case's size with QuadProgBox, each a small change
+// of the one before, as across time steps, so the working set carries over. Some bounds are
+// infinite. Fails if a solution breaks the KKT conditions by more than tol or, up to 6
+// variables, differs by more than tol from the best of all 3^n working sets.
+//     "box_qp": { "num_problems": 100, "tol": 1e-9, "cases": [ { "num_vars": 4 } ] }
+int checkBoxQP(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+// Steps each case with the sphere, cylinder and double cylinder solved with derivatives, and
+// every interval steps compares, for each obstacle, the analytic derivatives wrt the inputs
+// with central differences of the solve, and the moment arms with central differences of the
+// path length over the joint angles where the wrap status does not change within h. The
+// double cylinder iterates to full convergence. Fails if either differs by more than tol.
+//     "wrap_derivatives": { "num_steps": 500, "interval": 25, "h": 1e-6, "tol": 1e-6, "cases": [ {} ] }
+int checkWrapDerivatives(const std::string &RESOURCE_DIR, const nlohmann::json &base, const nlohmann::json &spec);
+
+#endif // MUSCLEMASS_BATCH_CHECKS_H_
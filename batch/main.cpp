@@ -0,0 +1,241 @@
+#include <cstdlib>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+#include <json.hpp>
+
+#include "Scene.h"
+#include "Joint.h"
+#include "Ensemble.h"
+#include "StepController.h"
+#include "Spring.h"
+#include "WrapDoubleCylinder.h"
+#include "Checks.h"
+
+using namespace std;
+using namespace Eigen;
+
+// Headless batch simulation: loads a scene, runs a fixed number of steps as fast
+// as possible and writes the trajectory and the timing. Nothing is drawn.
+//
+// Usage: MuscleMass <RESOURCE_DIR> [JSON_FILE=input.json] [NUM_STEPS=1000] [OUTPUT=trajectory.m]
+//
+// The trajectory is written as a Matlab matrix, one row per step:
+//     t, theta (num_joints), thetadot (num_joints), K, V
+// With "isAdaptive" each step is one accepted adaptive step, so t is not evenly spaced.
+//
+// If JSON_FILE has a "sweep" entry it is an ensemble specification (see Ensemble.h),
+// all of its members are run in parallel and gathered into OUTPUT (default ensemble.m).
+//
+// If JSON_FILE has a "tabulate" entry, the wrap obstacles of its "base" scene are fitted
+// and the tables written to OUTPUT (default wraptable.json). Point "wrap_table" of a scene at
+// that file, in RESOURCE_DIR, to use them instead of the solve. "min_theta" and "max_theta"
+// give the range per joint in degrees, the joint limits by default. Outside it, and for the
+// tables that miss the solve by more than "tol" and are not written, the obstacles solve.
+//     { "base": "input.json", "tabulate": { "basis": "cubic", "num_knots": 17, "tol": 1e-3,
+//       "min_theta": [-180, -90], "max_theta": [180, 90] } }
+//
+// If JSON_FILE has a "check" entry, the self-checks it names (see Checks.h) are run on its
+// "base" scene, and the exit code is 1 if any of them failed.
+//     { "base": "input.json", "check": { "allocations": { "cases": [ {}, { "isReduced": false } ] } } }
+
+static int runEnsemble(const string &RESOURCE_DIR, nlohmann::json spec, int argc, char **argv)
+{
+	if(argc > 3) {
+		spec["num_steps"] = atoi(argv[3]);
+	}
+	string OUTPUT = argc > 4 ? argv[4] : "ensemble.m";
+
+	Ensemble ensemble(RESOURCE_DIR, spec);
+	ensemble.run();
+	ensemble.save(OUTPUT);
+
+	cout << "members: " << ensemble.getNumMembers() << endl;
+	cout << "seconds: " << ensemble.getSeconds() << endl;
+	cout << "output: " << OUTPUT << endl;
+	return 0;
+}
+
+static int runTabulate(const string &RESOURCE_DIR, const nlohmann::json &spec, int argc, char **argv)
+{
+	string OUTPUT = argc > 4 ? argv[4] : "wraptable.json";
+	string base_file = spec.count("base") ? spec["base"].get<string>() : "input.json";
+	const auto &tabulate = spec["tabulate"];
+	string basis = tabulate.count("basis") ? tabulate["basis"].get<string>() : "cubic";
+	int num_knots = tabulate.count("num_knots") ? tabulate["num_knots"].get<int>() : 17;
+	double tol = tabulate.count("tol") ? tabulate["tol"].get<double>() : 1e-3;
+
+	auto scene = make_shared<Scene>();
+	scene->load(RESOURCE_DIR, base_file);
+	const auto &joints = scene->getJoints();
+	int nj = (int)joints.size();
+	VectorXd theta_min(nj), theta_max(nj);
+	for (int i = 0; i < nj; ++i) {
+		theta_min(i) = tabulate.count("min_theta") ? tabulate["min_theta"][i].get<double>() / 180.0 * PI : joints[i]->getMinTheta();
+		theta_max(i) = tabulate.count("max_theta") ? tabulate["max_theta"][i].get<double>() / 180.0 * PI : joints[i]->getMaxTheta();
+	}
+	auto t_start = chrono::steady_clock::now();
+	nlohmann::json tables = scene->tabulateWraps(basis, num_knots, tol, theta_min, theta_max);
+	auto t_stop = chrono::steady_clock::now();
+
+	ofstream ofs(OUTPUT);
+	ofs << tables;
+	ofs.close();
+
+	cout << "tables: " << tables.size() << endl;
+	cout << "seconds: " << chrono::duration<double>(t_stop - t_start).count() << endl;
+	cout << "output: " << OUTPUT << endl;
+	return 0;
+}
+
+static int runCheck(const string &RESOURCE_DIR, const nlohmann::json &spec)
+{
+	string base_file = spec.count("base") ? spec["base"].get<string>() : "input.json";
+	nlohmann::json base;
+	ifstream i(RESOURCE_DIR + base_file);
+	i >> base;
+	i.close();
+
+	const auto &check = spec["check"];
+	int num_failed = 0;
+	if(check.count("allocations")) {
+		num_failed += checkAllocations(RESOURCE_DIR, base, check["allocations"]);
+	}
+	if(check.count("spring_refresh")) {
+		num_failed += checkSpringRefresh(RESOURCE_DIR, base, check["spring_refresh"]);
+	}
+	if(check.count("inertia_cache")) {
+		num_failed += checkInertiaCache(RESOURCE_DIR, base, check["inertia_cache"]);
+	}
+	if(check.count("wrap_iterations")) {
+		num_failed += checkWrapIterations(RESOURCE_DIR, base, check["wrap_iterations"]);
+	}
+	if(check.count("wrap_batch")) {
+		num_failed += checkWrapBatch(RESOURCE_DIR, base, check["wrap_batch"]);
+	}
+	if(check.count("sparse_kkt")) {
+		num_failed += checkSparseKKT(RESOURCE_DIR, base, check["sparse_kkt"]);
+	}
+	if(check.count("se3")) {
+		num_failed += checkSE3(RESOURCE_DIR, base, check["se3"]);
+	}
+	if(check.count("rkf45_order")) {
+		num_failed += checkRKF45Order(RESOURCE_DIR, base, check["rkf45_order"]);
+	}
+	if(check.count("spring_stiffness")) {
+		num_failed += checkSpringStiffness(RESOURCE_DIR, base, check["spring_stiffness"]);
+	}
+	if(check.count("box_qp")) {
+		num_failed += checkBoxQP(RESOURCE_DIR, base, check["box_qp"]);
+	}
+	if(check.count("wrap_derivatives")) {
+		num_failed += checkWrapDerivatives(RESOURCE_DIR, base, check["wrap_derivatives"]);
+	}
+
+	cout << "failed: " << num_failed << endl;
+	return num_failed > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2) {
+		cout << "Usage: " << argv[0] << " <RESOURCE_DIR> [JSON_FILE] [NUM_STEPS] [OUTPUT]" << endl;
+		return 0;
+	}
+	string RESOURCE_DIR = argv[1] + string("/");
+	string JSON_FILE = argc > 2 ? argv[2] : "input.json";
+
+	nlohmann::json spec;
+	ifstream i(RESOURCE_DIR + JSON_FILE);
+	i >> spec;
+	i.close();
+	if(spec.count("sweep")) {
+		return runEnsemble(RESOURCE_DIR, spec, argc, argv);
+	}
+	if(spec.count("tabulate")) {
+		return runTabulate(RESOURCE_DIR, spec, argc, argv);
+	}
+	if(spec.count("check")) {
+		return runCheck(RESOURCE_DIR, spec);
+	}
+
+	int num_steps = argc > 3 ? atoi(argv[3]) : 1000;
+	string OUTPUT = argc > 4 ? argv[4] : "trajectory.m";
+
+	auto scene = make_shared<Scene>();
+	scene->load(RESOURCE_DIR, JSON_FILE);
+	scene->tare();
+
+	const auto &joints = scene->getJoints();
+	int nj = (int)joints.size();
+
+	// Preallocated so that recording does not add to the step time
+	MatrixXd traj(num_steps + 1, 3 + 2 * nj);
+	VectorXd thetalist(nj), thetadotlist(nj);
+
+	auto record = [&](int row) {
+		Joint::getThetaVector(joints, thetalist);
+		Joint::getThetadotVector(joints, thetadotlist);
+		traj(row, 0) = scene->getTime();
+		traj.block(row, 1, 1, nj) = thetalist.transpose();
+		traj.block(row, 1 + nj, 1, nj) = thetadotlist.transpose();
+		traj(row, 1 + 2 * nj) = scene->getKineticEnergy();
+		traj(row, 2 + 2 * nj) = scene->getPotentialEnergy();
+	};
+
+	scene->computeEnergy();
+	record(0);
+	const auto &wraps = scene->getWrapDoubleCylinders();
+	vector<int> wrap_iters(wraps.size(), 0);
+	vector<int> wrap_max_iters(wraps.size(), 0);
+	double max_drift = 0.0;
+	auto t_start = chrono::steady_clock::now();
+	for(int i = 0; i < num_steps; ++i) {
+		scene->step();
+		record(i + 1);
+		max_drift = max(max_drift, scene->getDrift());
+		for(int k = 0; k < (int)wraps.size(); ++k) {
+			wrap_iters[k] += wraps[k]->getNumIterations();
+			wrap_max_iters[k] = max(wrap_max_iters[k], wraps[k]->getNumIterations());
+		}
+	}
+	auto t_stop = chrono::steady_clock::now();
+	double seconds = chrono::duration<double>(t_stop - t_start).count();
+
+	ofstream ofs(OUTPUT);
+	ofs << setprecision(20);
+	ofs << "traj = [" << traj << "];\n\n";
+	ofs << "seconds = " << seconds << ";\n";
+	ofs.close();
+
+	cout << "steps: " << num_steps << endl;
+	cout << "seconds: " << seconds << endl;
+	cout << "steps per second: " << (seconds > 0.0 ? num_steps / seconds : 0.0) << endl;
+	if(scene->getStepController()) {
+		cout << "simulated time: " << scene->getTime() << endl;
+		scene->getStepController()->print();
+	}
+	cout << "max joint drift: " << max_drift << endl;
+	for(int k = 0; k < (int)wraps.size(); ++k) {
+		if(wrap_iters[k] > 0) {
+			cout << "double cylinder " << k << " iterations per step: " << wrap_iters[k] / (double)num_steps << " (max " << wrap_max_iters[k] << ")" << endl;
+		}
+	}
+	const auto &springs = scene->getSprings();
+	for(int k = 0; k < (int)springs.size(); ++k) {
+		cout << "spring " << k << " sample refreshes: " << springs[k]->getNumRefreshes() << " / " << springs[k]->getNumSteps() << endl;
+		cout << "spring " << k << " inertia cache hits: " << springs[k]->getNumCacheHits() << ", misses: " << springs[k]->getNumCacheMisses() << endl;
+	}
+	cout << "trajectory: " << OUTPUT << endl;
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(ML_COUNT_ALLOCATIONS) && defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+using namespace std;
+
+// Plain integers with static initialization, so that touching them from inside
+// malloc does not allocate
+static thread_local size_t alloc_count = 0;
+static thread_local size_t alloc_bytes = 0;
+
+static inline void countAlloc(size_t size) {
+	alloc_count += 1;
+	alloc_bytes += size;
+}
+
+void AllocationCounter::reset() {
+	alloc_count = 0;
+	alloc_bytes = 0;
+}
+
+size_t AllocationCounter::getCount() {
+	return alloc_count;
+}
+
+size_t AllocationCounter::getBytes() {
+	return alloc_bytes;
+}
+
+bool AllocationCounter::isEnabled() {
+#ifdef ML_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool AllocationCounter::isComplete() {
+#if defined(ML_COUNT_ALLOCATIONS) && (defined(__GLIBC__) || (defined(_MSC_VER) && defined(_DEBUG)))
+	return true;
+#else
+	return false;
+#endif
+}
+
+#if defined(ML_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+// glibc exports its allocator as __libc_*, and libstdc++'s operator new calls malloc,
+// so wrapping malloc sees both.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+	countAlloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+	countAlloc(num * size);
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *p, size_t size) {
+	countAlloc(size);
+	return __libc_realloc(p, size);
+}
+}
+#elif defined(ML_COUNT_ALLOCATIONS) && defined(_MSC_VER) && defined(_DEBUG)
+// The debug CRT calls the hook on every malloc, calloc, realloc and operator new.
+static int allocHook(int type, void *, size_t size, int, long, const unsigned char *, int) {
+	if (type == _HOOK_ALLOC || type == _HOOK_REALLOC) {
+		countAlloc(size);
+	}
+	return 1;
+}
+
+static struct AllocHookInstaller {
+	AllocHookInstaller() { _CrtSetAllocHook(allocHook); }
+} alloc_hook_installer;
+#elif defined(ML_COUNT_ALLOCATIONS)
+// Only the global operator new can be replaced, which does not see Eigen's heap storage.
+static void *countedAlloc(size_t size) {
+	countAlloc(size);
+	void *p = malloc(size == 0 ? 1 : size);
+	if (!p) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void *operator new(size_t size) {
+	return countedAlloc(size);
+}
+
+void *operator new[](size_t size) {
+	return countedAlloc(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+	try {
+		return countedAlloc(size);
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+	try {
+		return countedAlloc(size);
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+#endif // ML_COUNT_ALLOCATIONS
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_ALLOCATIONCOUNTER_H_
+#define MUSCLEMASS_SRC_ALLOCATIONCOUNTER_H_
+#include <cstddef>
+
+// Counts the heap allocations made by the calling thread, so that scenes stepping in
+// parallel (see Ensemble) each see their own. Both Eigen and operator new get their
+// memory from malloc, which is where the allocations are counted:
+//   glibc            malloc, calloc and realloc are wrapped around __libc_*
+//   MSVC debug CRT   an allocation hook (_CrtSetAllocHook) sees every heap request
+// Anywhere else (MSVC release, macOS, musl) only operator new can be replaced, which
+// misses Eigen's heap storage, and isComplete() is false.
+// The counting is only compiled in with ML_COUNT_ALLOCATIONS
+// (cmake -DCOUNT_ALLOCATIONS=ON), otherwise the counts stay at zero.
+class AllocationCounter
+{
+public:
+	static void reset();
+	static size_t getCount();	// number of allocations of this thread since its last reset
+	static size_t getBytes();	// bytes requested by this thread since its last reset
+	static bool isEnabled();
+	static bool isComplete();	// malloc itself is counted, not only operator new
+};
+
+#endif // MUSCLEMASS_SRC_ALLOCATIONCOUNTER_H_
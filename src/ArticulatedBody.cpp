@@ -0,0 +1,313 @@
+#include "ArticulatedBody.h"
+
+#include "Rigid.h"
+#include "Joint.h"
+#include "Spring.h"
+#include "Particle.h"
+#include "JacobianOperator.h"
+
+#include <iostream>
+
+using namespace std;
+using namespace Eigen;
+
+ArticulatedBody::ArticulatedBody(vector< shared_ptr<Rigid> > _boxes, vector< shared_ptr<Joint> > _joints, vector< shared_ptr<Spring> > _springs) :
+	num_joints((int)_boxes.size() - 1),
+	boxes(_boxes),
+	joints(_joints),
+	springs(_springs)
+{
+	int nb = (int)boxes.size();
+	jacobian = make_shared<JacobianOperator>(boxes);
+	parent.resize(nb);
+	E.resize(nb);
+	phi.resize(nb);
+	c.resize(nb);
+	f.resize(nb);
+	a_v.resize(nb);
+	I_A.resize(nb);
+	I_a.resize(nb);
+	U.resize(nb);
+	D.resize(nb);
+	axis.resize(nb);
+	origin.resize(nb);
+	p_A.resize(nb);
+	a.resize(nb);
+	u.resize(nb);
+
+	int ns = 6 * (int)springs.size();
+	U_s.resize(num_joints, ns);
+	W_s.resize(ns, ns);
+	f_s.resize(num_joints);
+	Jp.resize(3, num_joints);
+	Y.resize(num_joints, ns);
+	WU.resize(ns, num_joints);
+	C.resize(ns, ns);
+	C_lu = PartialPivLU<MatrixXd>(ns);
+	r.resize(num_joints);
+	z_s.resize(ns);
+	y_s.resize(ns);
+
+	// Boxes are stored parents first, so one sweep in each direction visits the tree in order
+	for (int i = 0; i < nb; ++i) {
+		auto p = boxes[i]->getParent();
+		parent[i] = p ? p->getIndex() : -1;
+		assert(parent[i] < i);
+	}
+}
+
+void ArticulatedBody::updateKinematics(const VectorXd &thetalist, const VectorXd &thetadotlist) {
+	// Joint transforms, adjoints and axes are shared with the Jacobian operator
+	jacobian->update(thetalist);
+
+	E[0] = boxes[0]->getE();
+	phi[0].setZero();
+	c[0].setZero();
+	a_v[0].setZero();
+
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		Matrix4d E_W_J = E[parent[i]] * boxes[i]->getJoint()->getE_P_J();
+		E[i] = E_W_J * Rigid::inverse(jacobian->getE_C_J(i));
+		axis[i] = E_W_J.block<3, 1>(0, 2);
+		origin[i] = E_W_J.block<3, 1>(0, 3);
+
+		// phi_C = Ad_C_P * phi_P + S * thetadot
+		Vector6d v_J = jacobian->getAxis(i) * thetadotlist(i - 1);
+		phi[i] = jacobian->getAdjoint(i) * phi[parent[i]] + v_J;
+
+		// Velocity product term, ad(phi_C) * S * thetadot
+		Matrix6d ad;
+		ad.setZero();
+		ad.block<3, 3>(0, 0) = Rigid::bracket3(phi[i].segment<3>(0));
+		ad.block<3, 3>(3, 0) = Rigid::bracket3(phi[i].segment<3>(3));
+		ad.block<3, 3>(3, 3) = Rigid::bracket3(phi[i].segment<3>(0));
+		c[i] = ad * v_J;
+		a_v[i] = jacobian->getAdjoint(i) * a_v[parent[i]] + c[i];
+	}
+
+	// Same forces as Rigid::computeForces(), evaluated at this state
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		auto box = boxes[i];
+		Matrix6d twist_bracket;
+		twist_bracket.setZero();
+		twist_bracket.block<3, 3>(0, 0) = Rigid::bracket3(phi[i].segment<3>(0));
+		twist_bracket.block<3, 3>(3, 3) = Rigid::bracket3(phi[i].segment<3>(0));
+
+		f[i] = twist_bracket.transpose() * box->getMassMatrix() * phi[i];
+		f[i].segment<3>(3) += box->m * E[i].block<3, 3>(0, 0).transpose() * box->grav;
+	}
+}
+
+void ArticulatedBody::updateArticulatedInertia() {
+	// Leaves to root
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		I_A[i] = boxes[i]->getMassMatrix();
+	}
+	for (int i = (int)boxes.size() - 1; i > 0; --i) {
+		U[i] = I_A[i] * jacobian->getAxis(i);
+		D[i] = jacobian->getAxis(i).dot(U[i]);
+		I_a[i] = I_A[i] - U[i] * U[i].transpose() / D[i];
+		I_A[parent[i]] += jacobian->getAdjoint(i).transpose() * I_a[i] * jacobian->getAdjoint(i);
+	}
+}
+
+void ArticulatedBody::solve(const Ref<const VectorXd> &tau, bool isBias, Ref<VectorXd> thetaddotlist) {
+	// Joint accelerations for the joint torques tau. Without the bias the result is H^-1 * tau,
+	// where H is the joint space inertia of the boxes; the articulated inertias are reused.
+	int nb = (int)boxes.size();
+	for (int i = 0; i < nb; ++i) {
+		if (isBias) {
+			p_A[i] = -f[i];
+		}
+		else {
+			p_A[i].setZero();
+		}
+	}
+
+	for (int i = nb - 1; i > 0; --i) {
+		u[i] = tau(i - 1) - jacobian->getAxis(i).dot(p_A[i]);
+		Vector6d p_a = p_A[i] + U[i] * (u[i] / D[i]);
+		if (isBias) {
+			p_a += I_a[i] * c[i];
+		}
+		p_A[parent[i]] += jacobian->getAdjoint(i).transpose() * p_a;
+	}
+
+	// Root to leaves, the first box does not move
+	a[0].setZero();
+	for (int i = 1; i < nb; ++i) {
+		Vector6d a_P = jacobian->getAdjoint(i) * a[parent[i]];
+		if (isBias) {
+			a_P += c[i];
+		}
+		thetaddotlist(i - 1) = (u[i] - U[i].dot(a_P)) / D[i];
+		a[i] = a_P + jacobian->getAxis(i) * thetaddotlist(i - 1);
+	}
+}
+
+void ArticulatedBody::computeSpringTerms() {
+	// M_s = U_s * W_s * U_s^T, with U_s = [J0^T J1^T] and W_s the mass moments of each spring
+	U_s.setZero();
+	W_s.setZero();
+	f_s.setZero();
+
+	Matrix3d I3 = Matrix3d::Identity();
+	for (int k = 0; k < (int)springs.size(); ++k) {
+		auto spring = springs[k];
+		Particle *points[2] = { spring->p0.get(), spring->p1.get() };
+		double mu[2] = { spring->mu0, spring->mu1 };
+
+		Vector3d p[2];
+		for (int e = 0; e < 2; ++e) {
+			int ib = points[e]->getParent()->getIndex();
+			p[e] = E[ib].block<3, 3>(0, 0) * points[e]->x0 + E[ib].block<3, 1>(0, 3);
+		}
+
+		// Elastic pull -E (l - L) u on p1 and the opposite on p0
+		Vector3d f_e[2];
+		f_e[0].setZero();
+		f_e[1].setZero();
+		if (spring->isElastic) {
+			Vector3d dx = p[1] - p[0];
+			double len = dx.norm();
+			f_e[1] = -spring->E * (len - spring->L) / len * dx;
+			f_e[0] = -f_e[1];
+		}
+
+		for (int e = 0; e < 2; ++e) {
+			int ib = points[e]->getParent()->getIndex();
+			Jp.setZero();
+
+			// Every joint on the way down to the root moves the point
+			for (int i = ib; i > 0; i = parent[i]) {
+				Jp.col(i - 1) = axis[i].cross(p[e] - origin[i]);
+			}
+			U_s.block(0, 6 * k + 3 * e, num_joints, 3) = Jp.transpose();
+			f_s.noalias() += Jp.transpose() * (mu[e] * spring->grav + f_e[e]);
+		}
+
+		W_s.block<3, 3>(6 * k, 6 * k) = spring->mu00 * I3;
+		W_s.block<3, 3>(6 * k, 6 * k + 3) = spring->mu01 * I3;
+		W_s.block<3, 3>(6 * k + 3, 6 * k) = spring->mu01 * I3;
+		W_s.block<3, 3>(6 * k + 3, 6 * k + 3) = spring->mu11 * I3;
+	}
+
+	// The spring inertia depends on the configuration, its velocity product is a force too
+	r.setZero();
+	addSpringVelocityProduct(r);
+	f_s -= r;
+}
+
+void ArticulatedBody::addSpringVelocityProduct(Ref<VectorXd> c_vp) const {
+	// With T_s = 1/2 sum_ab mu_ab pdot_a . pdot_b, the velocity product is
+	// sum_ab mu_ab J_a^T (Jdot_b thetadot). The terms from dM_s/dtheta cancel because each
+	// endpoint Jacobian is the gradient of its position.
+	for (int k = 0; k < (int)springs.size(); ++k) {
+		auto spring = springs[k];
+		Particle *points[2] = { spring->p0.get(), spring->p1.get() };
+
+		// World position and velocity product acceleration of the endpoints, from the
+		// body twist [w; v] and the body acceleration at zero thetaddot
+		Vector3d p[2], pddot[2];
+		for (int e = 0; e < 2; ++e) {
+			int ib = points[e]->getParent()->getIndex();
+			const Vector3d &x0 = points[e]->x0;
+			Matrix3d R = E[ib].block<3, 3>(0, 0);
+			Vector3d w = phi[ib].segment<3>(0);
+			Vector3d v = phi[ib].segment<3>(3);
+			p[e] = R * x0 + E[ib].block<3, 1>(0, 3);
+			pddot[e] = R * (w.cross(w.cross(x0) + v) + a_v[ib].segment<3>(0).cross(x0) + a_v[ib].segment<3>(3));
+		}
+
+		Vector3d g[2];
+		g[0] = spring->mu00 * pddot[0] + spring->mu01 * pddot[1];
+		g[1] = spring->mu01 * pddot[0] + spring->mu11 * pddot[1];
+		for (int e = 0; e < 2; ++e) {
+			// J_a^T g, walking the joints on the way down to the root
+			for (int i = points[e]->getParent()->getIndex(); i > 0; i = parent[i]) {
+				c_vp(i - 1) += axis[i].cross(p[e] - origin[i]).dot(g[e]);
+			}
+		}
+	}
+}
+
+void ArticulatedBody::computeVelocityProduct(const VectorXd &thetalist, const VectorXd &thetadotlist, VectorXd &c_vp) {
+	c_vp.resize(num_joints);
+	updateKinematics(thetalist, thetadotlist);
+
+	// Inverse dynamics at zero thetaddot and zero gravity, leaves to root.
+	// Each box needs M a_v - f_coriolis from the joint and its children.
+	int nb = (int)boxes.size();
+	for (int i = 0; i < nb; ++i) {
+		p_A[i] = boxes[i]->getMassMatrix() * a_v[i] - f[i];
+		p_A[i].segment<3>(3) += boxes[i]->m * E[i].block<3, 3>(0, 0).transpose() * boxes[i]->grav;
+	}
+	for (int i = nb - 1; i > 0; --i) {
+		c_vp(i - 1) = jacobian->getAxis(i).dot(p_A[i]);
+		p_A[parent[i]] += jacobian->getAdjoint(i).transpose() * p_A[i];
+	}
+
+	addSpringVelocityProduct(c_vp);
+}
+
+VectorXd ArticulatedBody::computeAcceleration(const VectorXd &thetalist, const VectorXd &thetadotlist) {
+	VectorXd thetaddotlist(num_joints);
+	computeAcceleration(thetalist, thetadotlist, thetaddotlist);
+	return thetaddotlist;
+}
+
+void ArticulatedBody::computeAcceleration(const VectorXd &thetalist, const VectorXd &thetadotlist, VectorXd &thetaddotlist) {
+	thetaddotlist.resize(num_joints);
+	updateKinematics(thetalist, thetadotlist);
+	updateArticulatedInertia();
+
+	if (springs.empty()) {
+		r.setZero();
+		solve(r, true, thetaddotlist);
+		return;
+	}
+
+	// (H + U_s W_s U_s^T) thetaddot = tau, by the Woodbury identity
+	// thetaddot = r - Y (I + W_s U_s^T Y)^-1 W_s U_s^T r, with r = H^-1 tau and Y = H^-1 U_s
+	computeSpringTerms();
+
+	solve(f_s, true, r);
+	for (int k = 0; k < (int)U_s.cols(); ++k) {
+		solve(U_s.col(k), false, Y.col(k));
+	}
+
+	WU.noalias() = W_s * U_s.transpose();
+	C.setIdentity();
+	C.noalias() += WU * Y;
+	C_lu.compute(C);
+
+	y_s.noalias() = WU * r;
+	z_s = C_lu.solve(y_s);
+	thetaddotlist = r;
+	thetaddotlist.noalias() -= Y * z_s;
+}
+
+void ArticulatedBody::computeSpringMassMatrix(MatrixXd &M_s) const {
+	M_s.resize(num_joints, num_joints);
+	if (springs.empty()) {
+		M_s.setZero();
+		return;
+	}
+	M_s.noalias() = U_s * WU;
+}
+
+VectorXd ArticulatedBody::computeTwists(const VectorXd &thetadotlist) const {
+	VectorXd twists;
+	computeTwists(thetadotlist, twists);
+	return twists;
+}
+
+void ArticulatedBody::computeTwists(const VectorXd &thetadotlist, VectorXd &twists) const {
+	// Twists of all the boxes for the joint velocities, at the last configuration
+	jacobian->multiplyJoints(thetadotlist, twists);
+}
+
+ArticulatedBody::~ArticulatedBody()
+{
+
+}
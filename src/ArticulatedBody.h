@@ -0,0 +1,86 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_ARTICULATEDBODY_H_
+#define MUSCLEMASS_SRC_ARTICULATEDBODY_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class Rigid;
+class Joint;
+class Spring;
+class JacobianOperator;
+
+// Recursive forward dynamics in reduced coordinates (articulated-body algorithm).
+// Box 0 is fixed, box i is attached to its parent by the revolute joint i - 1.
+// The inertia of the springs is added in joint space through a low rank update.
+// The velocity product terms of the boxes and of the springs are computed recursively,
+// without differentiating the mass matrix.
+class ArticulatedBody
+{
+public:
+	ArticulatedBody(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Joint> > _joints, std::vector< std::shared_ptr<Spring> > _springs);
+	virtual ~ArticulatedBody();
+
+	Eigen::VectorXd computeAcceleration(const Eigen::VectorXd &thetalist, const Eigen::VectorXd &thetadotlist);
+	Eigen::VectorXd computeTwists(const Eigen::VectorXd &thetadotlist) const;
+	void computeAcceleration(const Eigen::VectorXd &thetalist, const Eigen::VectorXd &thetadotlist, Eigen::VectorXd &thetaddotlist);
+	void computeTwists(const Eigen::VectorXd &thetadotlist, Eigen::VectorXd &twists) const;
+	// c(theta, thetadot) in H(theta) thetaddot + c = tau, for the boxes and the spring inertia
+	void computeVelocityProduct(const Eigen::VectorXd &thetalist, const Eigen::VectorXd &thetadotlist, Eigen::VectorXd &c_vp);
+	// Joint space spring inertia U_s W_s U_s^T that the last computeAcceleration() used
+	void computeSpringMassMatrix(Eigen::MatrixXd &M_s) const;
+	Eigen::Matrix4d getE(int i) const { return this->E[i]; }
+	// Adjoints and joint axes at the last configuration
+	std::shared_ptr<JacobianOperator> getJacobian() const { return this->jacobian; }
+
+	const int num_joints;
+
+private:
+	void updateKinematics(const Eigen::VectorXd &thetalist, const Eigen::VectorXd &thetadotlist);
+	void updateArticulatedInertia();
+	void solve(const Eigen::Ref<const Eigen::VectorXd> &tau, bool isBias, Eigen::Ref<Eigen::VectorXd> thetaddotlist);
+	void computeSpringTerms();
+	void addSpringVelocityProduct(Eigen::Ref<Eigen::VectorXd> c_vp) const;
+
+	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector< std::shared_ptr<Joint> > joints;
+	std::vector< std::shared_ptr<Spring> > springs;
+
+	std::shared_ptr<JacobianOperator> jacobian;
+
+	std::vector<int> parent;				// parent box index, -1 for the fixed box
+	std::vector<Eigen::Matrix4d> E;			// where each box is wrt world
+	std::vector<Vector6d> phi;				// body twist
+	std::vector<Vector6d> c;				// velocity product acceleration
+	std::vector<Vector6d> f;				// coriolis and gravity force in body coords
+	std::vector<Vector6d> a_v;				// body acceleration when thetaddot = 0
+	std::vector<Matrix6d> I_A;				// articulated inertia
+	std::vector<Matrix6d> I_a;				// articulated inertia seen through the joint
+	std::vector<Vector6d> U;				// I_A * S
+	std::vector<double> D;					// S^T * I_A * S
+	std::vector<Eigen::Vector3d> axis;		// joint axis wrt world
+	std::vector<Eigen::Vector3d> origin;	// joint position wrt world
+
+	// Workspace for solve(), sized at construction
+	std::vector<Vector6d> p_A;				// articulated bias force
+	std::vector<Vector6d> a;				// body acceleration
+	std::vector<double> u;
+
+	// Workspace for the spring terms, sized at construction
+	Eigen::MatrixXd U_s;					// [J0^T J1^T] of each spring
+	Eigen::MatrixXd W_s;					// mass moments of each spring
+	Eigen::VectorXd f_s;					// spring gravity and elastic force in joint space
+	Eigen::MatrixXd Jp;						// endpoint jacobian
+	Eigen::MatrixXd Y;						// H^-1 * U_s
+	Eigen::MatrixXd WU;						// W_s * U_s^T
+	Eigen::MatrixXd C;						// I + W_s * U_s^T * Y
+	Eigen::PartialPivLU<Eigen::MatrixXd> C_lu;
+	Eigen::VectorXd r;
+	Eigen::VectorXd z_s;
+	Eigen::VectorXd y_s;
+};
+
+#endif // MUSCLEMASS_SRC_ARTICULATEDBODY_H_
@@ -0,0 +1,97 @@
+#include "ChainKinematics.h"
+
+#include "Rigid.h"
+#include "Joint.h"
+#include "JacobianOperator.h"
+
+using namespace std;
+using namespace Eigen;
+
+shared_ptr<ChainKinematicsBase> ChainKinematicsBase::create(const vector< shared_ptr<Rigid> > &boxes)
+{
+	switch ((int)boxes.size() - 1) {
+	case 2: return make_shared< ChainKinematics<2> >(boxes);
+	case 3: return make_shared< ChainKinematics<3> >(boxes);
+	case 4: return make_shared< ChainKinematics<4> >(boxes);
+	case 5: return make_shared< ChainKinematics<5> >(boxes);
+	case 6: return make_shared< ChainKinematics<6> >(boxes);
+	case 7: return make_shared< ChainKinematics<7> >(boxes);
+	case 8: return make_shared< ChainKinematics<8> >(boxes);
+	default: return make_shared< ChainKinematics<Dynamic> >(boxes);
+	}
+}
+
+template <int N>
+ChainKinematics<N>::ChainKinematics(const vector< shared_ptr<Rigid> > &_boxes) :
+	n((int)_boxes.size() - 1),
+	boxes(_boxes)
+{
+	assert(N == Dynamic || N == n);
+	int nb = n + 1;
+	parent.resize(nb);
+	M_b.resize(nb);
+	E_J_P.resize(nb);
+	E.resize(nb);
+	J_b.resize(nb);
+
+	for (int i = 0; i < nb; ++i) {
+		auto p = boxes[i]->getParent();
+		parent[i] = p ? p->getIndex() : -1;
+		assert(parent[i] < i);
+		M_b[i] = boxes[i]->getMassMatrix();
+		if (i > 0) {
+			E_J_P[i] = Rigid::inverse(boxes[i]->getJoint()->getE_P_J());
+		}
+		J_b[i].setZero(6, n);
+	}
+	E[0] = boxes[0]->getE();
+	jacobian = make_shared<JacobianOperator>(boxes);
+	tau_N.setZero(n);
+	M_N.setZero(n, n);
+	MJ.setZero(6, n);
+}
+
+template <int N>
+void ChainKinematics<N>::update(const VectorXd &thetalist) {
+	jacobian->update(thetalist);
+
+	// Root to leaves, J_C = Ad_C_P * J_P + S e_{i-1}^T, the twist recursion on every column
+	for (int i = 1; i <= getNumJoints(); ++i) {
+		E[i] = E[parent[i]] * Rigid::inverse(jacobian->getE_C_J(i) * E_J_P[i]);
+		J_b[i].noalias() = jacobian->getAdjoint(i) * J_b[parent[i]];
+		J_b[i].col(i - 1) += jacobian->getAxis(i);
+	}
+}
+
+template <int N>
+void ChainKinematics<N>::computeTwists(const VectorXd &thetadotlist, VectorXd &twists) const {
+	jacobian->multiplyJoints(thetadotlist, twists);
+}
+
+template <int N>
+void ChainKinematics<N>::computeMassMatrix(MatrixXd &M) const {
+	M_N.setZero();
+	for (int i = 1; i <= getNumJoints(); ++i) {
+		MJ.noalias() = M_b[i] * J_b[i];
+		M_N.noalias() += J_b[i].transpose() * MJ;
+	}
+	M = M_N;
+}
+
+template <int N>
+void ChainKinematics<N>::computeForce(const VectorXd &f, VectorXd &tau) const {
+	tau_N.setZero();
+	for (int i = 1; i <= getNumJoints(); ++i) {
+		tau_N.noalias() += J_b[i].transpose() * f.segment<6>(6 * i);
+	}
+	tau = tau_N;
+}
+
+template class ChainKinematics<2>;
+template class ChainKinematics<3>;
+template class ChainKinematics<4>;
+template class ChainKinematics<5>;
+template class ChainKinematics<6>;
+template class ChainKinematics<7>;
+template class ChainKinematics<8>;
+template class ChainKinematics<Dynamic>;
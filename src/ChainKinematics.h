@@ -0,0 +1,73 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_CHAINKINEMATICS_H_
+#define MUSCLEMASS_SRC_CHAINKINEMATICS_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class Rigid;
+class JacobianOperator;
+
+// Reduced coordinate kinematics of a fixed tree of boxes: poses, body twist Jacobians,
+// joint space inertia and generalized forces. Box 0 is fixed, box i hangs from joint i - 1.
+// The joint transforms and the twist recursion are those of JacobianOperator, the Jacobians
+// are that recursion applied to all the joint columns at once.
+// ChainKinematics<N> is specialized on the number of joints N, so the Jacobians are 6 x N
+// fixed-size matrices and the loops have compile-time bounds. create() picks the
+// specialization for 2 to 8 joints and falls back to dynamic sizes otherwise.
+class ChainKinematicsBase
+{
+public:
+	virtual ~ChainKinematicsBase() {}
+
+	// Poses and Jacobians at the joint angles thetalist
+	virtual void update(const Eigen::VectorXd &thetalist) = 0;
+	// Twists of all the boxes (6 per box) for the joint velocities
+	virtual void computeTwists(const Eigen::VectorXd &thetadotlist, Eigen::VectorXd &twists) const = 0;
+	// sum_i J_i^T M_i J_i
+	virtual void computeMassMatrix(Eigen::MatrixXd &M) const = 0;
+	// sum_i J_i^T f_i, for body forces f (6 per box)
+	virtual void computeForce(const Eigen::VectorXd &f, Eigen::VectorXd &tau) const = 0;
+	virtual const Eigen::Matrix4d &getE(int i) const = 0;
+	virtual int getNumJoints() const = 0;
+
+	static std::shared_ptr<ChainKinematicsBase> create(const std::vector< std::shared_ptr<Rigid> > &boxes);
+};
+
+template <int N>
+class ChainKinematics : public ChainKinematicsBase
+{
+public:
+	typedef Eigen::Matrix<double, N, 1> VectorNd;
+	typedef Eigen::Matrix<double, N, N> MatrixNd;
+	typedef Eigen::Matrix<double, 6, N> Matrix6Nd;
+	typedef Eigen::Matrix<double, 3, N> Matrix3Nd;
+
+	ChainKinematics(const std::vector< std::shared_ptr<Rigid> > &_boxes);
+	virtual ~ChainKinematics() {}
+
+	void update(const Eigen::VectorXd &thetalist);
+	void computeTwists(const Eigen::VectorXd &thetadotlist, Eigen::VectorXd &twists) const;
+	void computeMassMatrix(Eigen::MatrixXd &M) const;
+	void computeForce(const Eigen::VectorXd &f, Eigen::VectorXd &tau) const;
+	const Eigen::Matrix4d &getE(int i) const { return this->E[i]; }
+	int getNumJoints() const { return N == Eigen::Dynamic ? this->n : N; }
+
+private:
+	const int n;							// number of joints
+	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector<int> parent;				// parent box index, -1 for the fixed box
+	std::vector<Matrix6d> M_b;				// box inertia
+	std::vector<Eigen::Matrix4d> E_J_P;		// parent wrt joint
+	std::vector<Eigen::Matrix4d> E;			// where each box is wrt world
+	std::vector<Matrix6Nd> J_b;				// body twist wrt thetadot
+	std::shared_ptr<JacobianOperator> jacobian;
+	mutable VectorNd tau_N;
+	mutable MatrixNd M_N;
+	mutable Matrix6Nd MJ;
+};
+
+#endif // MUSCLEMASS_SRC_CHAINKINEMATICS_H_
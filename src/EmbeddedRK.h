@@ -0,0 +1,171 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_EMBEDDEDRK_H_
+#define MUSCLEMASS_SRC_EMBEDDEDRK_H_
+#include <cmath>
+#include <algorithm>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+// Adaptive Runge-Kutta-Fehlberg 4(5) for y' = f(t, y), advancing with the fifth order
+// solution and using the embedded fourth order one for the error estimate.
+// RHS is any callable f(double t, const Eigen::VectorXd &y, Eigen::VectorXd &yp); it is a
+// template parameter so the six stage evaluations are direct calls.
+// After a step is accepted the derivative at the new point is evaluated once and kept:
+// it closes the cubic Hermite dense output over the step and is the first stage of the
+// next step, so each step costs six evaluations.
+template <class RHS>
+class EmbeddedRK
+{
+public:
+	EmbeddedRK(RHS &_f, int _n) :
+		f(_f),
+		n(_n),
+		abserr(1e-8),
+		relerr(1e-8),
+		h_min(1e-12),
+		h_max(1.0),
+		t(0.0),
+		t_old(0.0),
+		h(0.0),
+		h_next(0.0),
+		num_steps(0),
+		num_rejected(0),
+		num_evals(0)
+	{
+		y.resize(n);
+		y_old.resize(n);
+		yp.resize(n);
+		yp_old.resize(n);
+		ys.resize(n);
+		err.resize(n);
+		for (int s = 0; s < 5; ++s) {
+			k[s].resize(n);
+		}
+	}
+
+	void setTolerance(double _abserr, double _relerr) { this->abserr = _abserr; this->relerr = _relerr; }
+	void setStepLimits(double _h_min, double _h_max) { this->h_min = _h_min; this->h_max = _h_max; }
+
+	// Restart from (t, y), the step size is kept if one was already found
+	void init(double _t, const Eigen::VectorXd &_y) {
+		t = _t;
+		t_old = _t;
+		y = _y;
+		y_old = _y;
+		f(t, y, yp);
+		yp_old = yp;
+		num_evals++;
+		if (h_next <= 0.0) {
+			// Step that moves y by about the tolerance at the initial rate
+			double scale = (abserr + relerr * y.cwiseAbs().maxCoeff()) / (yp.cwiseAbs().maxCoeff() + 1e-16);
+			h_next = std::min(h_max, std::max(h_min, std::pow(scale, 0.2)));
+		}
+	}
+
+	// Take one accepted step, retrying with a smaller step while the error is too large
+	void step() {
+		for (;;) {
+			h = h_next;
+			double e = attempt(h);
+			// Standard controller for a fifth order pair, limited to [0.1, 5] times the step
+			double factor = e > 0.0 ? 0.9 * std::pow(e, -0.2) : 5.0;
+			factor = std::min(5.0, std::max(0.1, factor));
+			h_next = std::min(h_max, std::max(h_min, h * factor));
+			if (e <= 1.0 || h <= h_min) {
+				break;
+			}
+			num_rejected++;
+		}
+
+		y_old.swap(y);
+		yp_old.swap(yp);
+		y.swap(ys);
+		t_old = t;
+		t += h;
+		f(t, y, yp);
+		num_evals++;
+		num_steps++;
+	}
+
+	// Step until the accepted steps cover t_out, then sample there
+	void integrate(double t_out, Eigen::VectorXd &y_out) {
+		while (t < t_out) {
+			step();
+		}
+		interpolate(t_out, y_out);
+	}
+
+	// Cubic Hermite interpolant of the last accepted step, valid for t_old <= s <= t
+	void interpolate(double s, Eigen::VectorXd &y_out) const {
+		double dt = t - t_old;
+		if (dt <= 0.0) {
+			y_out = y;
+			return;
+		}
+		double th = (s - t_old) / dt;
+		double h00 = (1.0 + 2.0 * th) * (1.0 - th) * (1.0 - th);
+		double h10 = th * (1.0 - th) * (1.0 - th);
+		double h01 = th * th * (3.0 - 2.0 * th);
+		double h11 = th * th * (th - 1.0);
+		y_out = h00 * y_old + h01 * y;
+		y_out += (h10 * dt) * yp_old;
+		y_out += (h11 * dt) * yp;
+	}
+
+	double getTime() const { return this->t; }
+	double getStepSize() const { return this->h_next; }
+	const Eigen::VectorXd &getY() const { return this->y; }
+	int getNumSteps() const { return this->num_steps; }
+	int getNumRejected() const { return this->num_rejected; }
+	int getNumEvaluations() const { return this->num_evals; }
+
+private:
+	// Fifth order solution into ys, returns the scaled error norm
+	double attempt(double hh) {
+		ys = y + (hh / 4.0) * yp;
+		f(t + hh / 4.0, ys, k[0]);
+		ys = y + hh * (3.0 / 32.0 * yp + 9.0 / 32.0 * k[0]);
+		f(t + 3.0 * hh / 8.0, ys, k[1]);
+		ys = y + hh * (1932.0 / 2197.0 * yp - 7200.0 / 2197.0 * k[0] + 7296.0 / 2197.0 * k[1]);
+		f(t + 12.0 * hh / 13.0, ys, k[2]);
+		ys = y + hh * (439.0 / 216.0 * yp - 8.0 * k[0] + 3680.0 / 513.0 * k[1] - 845.0 / 4104.0 * k[2]);
+		f(t + hh, ys, k[3]);
+		ys = y + hh * (-8.0 / 27.0 * yp + 2.0 * k[0] - 3544.0 / 2565.0 * k[1] + 1859.0 / 4104.0 * k[2] - 11.0 / 40.0 * k[3]);
+		f(t + hh / 2.0, ys, k[4]);
+		num_evals += 5;
+
+		ys = y + hh * (16.0 / 135.0 * yp + 6656.0 / 12825.0 * k[1] + 28561.0 / 56430.0 * k[2] - 9.0 / 50.0 * k[3] + 2.0 / 55.0 * k[4]);
+		err = hh * (1.0 / 360.0 * yp - 128.0 / 4275.0 * k[1] - 2197.0 / 75240.0 * k[2] + 1.0 / 50.0 * k[3] + 2.0 / 55.0 * k[4]);
+
+		double e = 0.0;
+		for (int i = 0; i < n; ++i) {
+			double scale = abserr + relerr * std::max(std::abs(y(i)), std::abs(ys(i)));
+			e = std::max(e, std::abs(err(i)) / scale);
+		}
+		return e;
+	}
+
+	RHS &f;
+	const int n;
+	double abserr;
+	double relerr;
+	double h_min;
+	double h_max;
+	double t;				// end of the last accepted step
+	double t_old;			// start of the last accepted step
+	double h;				// last accepted step
+	double h_next;			// proposed next step
+	Eigen::VectorXd y;
+	Eigen::VectorXd y_old;
+	Eigen::VectorXd yp;		// f(t, y), first stage of the next step
+	Eigen::VectorXd yp_old;
+	Eigen::VectorXd ys;		// stage argument, then the new solution
+	Eigen::VectorXd err;
+	Eigen::VectorXd k[5];	// stages 2 to 6
+	int num_steps;
+	int num_rejected;
+	int num_evals;
+};
+
+#endif // MUSCLEMASS_SRC_EMBEDDEDRK_H_
@@ -0,0 +1,153 @@
+#include "Ensemble.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <limits>
+
+#include "Scene.h"
+#include "Joint.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+Ensemble::Ensemble(const string &_RESOURCE_DIR, const json &spec) :
+	RESOURCE_DIR(_RESOURCE_DIR),
+	num_steps(1000),
+	record_every(1),
+	num_threads(0),
+	seconds(0.0)
+{
+	if (spec.count("num_steps")) {
+		num_steps = spec["num_steps"];
+	}
+	if (spec.count("record_every")) {
+		record_every = max(1, spec["record_every"].get<int>());
+	}
+	if (spec.count("num_threads")) {
+		num_threads = spec["num_threads"];
+	}
+
+	string base_file = spec.count("base") ? spec["base"].get<string>() : "input.json";
+	json base;
+	ifstream i(RESOURCE_DIR + base_file);
+	i >> base;
+	i.close();
+
+	// Members write no plot data, saveData() appends to a shared file
+	base["isPlotEnergy"] = false;
+
+	// Cartesian product of the swept values
+	vector<json> values;
+	const json &sweep = spec["sweep"];
+	for (auto it = sweep.begin(); it != sweep.end(); ++it) {
+		keys.push_back(it.key());
+		values.push_back(it.value());
+	}
+
+	int num_members = 1;
+	for (int j = 0; j < (int)keys.size(); ++j) {
+		num_members *= (int)values[j].size();
+	}
+
+	params.resize(num_members, keys.size());
+	vector<int> index(keys.size(), 0);
+	for (int k = 0; k < num_members; ++k) {
+		json member = base;
+		for (int j = 0; j < (int)keys.size(); ++j) {
+			const json &value = values[j][index[j]];
+			member[keys[j]] = value;
+			params(k, j) = value.is_number() ? value.get<double>() : numeric_limits<double>::quiet_NaN();
+		}
+		members.push_back(member);
+
+		// Next combination, the last key varies fastest
+		for (int j = (int)keys.size() - 1; j >= 0; --j) {
+			if (++index[j] < (int)values[j].size()) {
+				break;
+			}
+			index[j] = 0;
+		}
+	}
+
+	trajs.resize(num_members);
+	member_seconds.setZero(num_members);
+}
+
+void Ensemble::runMember(int k) {
+	auto scene = make_shared<Scene>();
+	scene->loadFromJson(RESOURCE_DIR, members[k]);
+	scene->tare();
+	scene->computeEnergy();
+
+	const auto &joints = scene->getJoints();
+	int nj = (int)joints.size();
+	MatrixXd &traj = trajs[k];
+	traj.resize(num_steps / record_every + 1, 3 + 2 * nj);
+	VectorXd thetalist(nj), thetadotlist(nj);
+
+	int row = 0;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i <= num_steps; ++i) {
+		if (i > 0) {
+			scene->step();
+		}
+		if (i % record_every == 0) {
+			Joint::getThetaVector(joints, thetalist);
+			Joint::getThetadotVector(joints, thetadotlist);
+			traj(row, 0) = scene->getTime();
+			traj.block(row, 1, 1, nj) = thetalist.transpose();
+			traj.block(row, 1 + nj, 1, nj) = thetadotlist.transpose();
+			traj(row, 1 + 2 * nj) = scene->getKineticEnergy();
+			traj(row, 2 + 2 * nj) = scene->getPotentialEnergy();
+			row++;
+		}
+	}
+	member_seconds(k) = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Ensemble::run() {
+	auto start = chrono::steady_clock::now();
+	{
+		// Each member only writes its own slot of trajs and member_seconds
+		WorkStealingPool pool(num_threads);
+		for (int k = 0; k < (int)members.size(); ++k) {
+			pool.submit([this, k] { runMember(k); });
+		}
+		pool.wait();
+	}
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Ensemble::save(const string &file_name) const {
+	// One Matlab file: the swept keys, the values of each member, and all trajectories
+	// stacked with the member index (1-based) in the first column
+	ofstream ofs(file_name);
+	ofs << setprecision(20);
+
+	ofs << "keys = {";
+	for (int j = 0; j < (int)keys.size(); ++j) {
+		ofs << (j > 0 ? ", " : "") << "'" << keys[j] << "'";
+	}
+	ofs << "};\n\n";
+	ofs << "params = [" << params << "];\n\n";
+	ofs << "member_seconds = [" << member_seconds << "];\n\n";
+	ofs << "seconds = " << seconds << ";\n\n";
+
+	ofs << "traj = [";
+	for (int k = 0; k < (int)trajs.size(); ++k) {
+		for (int r = 0; r < (int)trajs[k].rows(); ++r) {
+			ofs << k + 1 << " " << trajs[k].row(r) << "\n";
+		}
+	}
+	ofs << "];\n";
+	ofs.close();
+}
+
+Ensemble::~Ensemble()
+{
+
+}
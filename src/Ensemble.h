@@ -0,0 +1,44 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_ENSEMBLE_H_
+#define MUSCLEMASS_SRC_ENSEMBLE_H_
+#include <vector>
+#include <memory>
+#include <string>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <json.hpp>
+
+// Parameter sweep over independent copies of Scene.
+// The sweep file names a base scene JSON and, for each key to vary, a list of values:
+//     { "base": "input.json", "num_steps": 1000, "record_every": 10, "num_threads": 0,
+//       "sweep": { "stiffness": [1e2, 1e3], "spring_mass": [2.1, 4.2] } }
+// Every combination of the values is one member. The members run on a work-stealing pool,
+// each with its own Scene, and their trajectories are gathered into one Matlab file.
+class Ensemble
+{
+public:
+	Ensemble(const std::string &_RESOURCE_DIR, const nlohmann::json &spec);
+	virtual ~Ensemble();
+
+	void run();
+	void save(const std::string &file_name) const;
+	int getNumMembers() const { return (int)this->members.size(); }
+	double getSeconds() const { return this->seconds; }
+
+private:
+	void runMember(int k);
+
+	std::string RESOURCE_DIR;
+	std::vector<std::string> keys;			// swept keys
+	std::vector<nlohmann::json> members;	// base JSON with the swept values written in
+	Eigen::MatrixXd params;					// swept values of each member, NaN if not a number
+	std::vector<Eigen::MatrixXd> trajs;		// t, theta, thetadot, K, V every record_every steps
+	Eigen::VectorXd member_seconds;			// wall time of each member
+	int num_steps;
+	int record_every;
+	int num_threads;
+	double seconds;							// wall time of the whole ensemble
+};
+
+#endif // MUSCLEMASS_SRC_ENSEMBLE_H_
@@ -0,0 +1,83 @@
+#include "FactorizationCache.h"
+
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+using namespace Eigen;
+
+FactorizationCache::FactorizationCache(int _n, double _tol, int _max_iters) :
+	n(_n),
+	tol(_tol),
+	max_iters(_max_iters),
+	isFactored(false),
+	num_solves(0),
+	num_factorizations(0),
+	num_iters(0)
+{
+	ldlt = LDLT<MatrixXd>(n);
+	r.resize(n);
+	z.resize(n);
+	p.resize(n);
+	Ap.resize(n);
+}
+
+FactorizationCache::~FactorizationCache()
+{
+
+}
+
+void FactorizationCache::factor(const MatrixXd &A) {
+	ldlt.compute(A);
+	isFactored = true;
+	num_factorizations++;
+}
+
+void FactorizationCache::solve(const MatrixXd &A, const VectorXd &b, VectorXd &x) {
+	num_solves++;
+	if (!isFactored || tol <= 0.0 || n < MIN_SIZE) {
+		factor(A);
+		x = ldlt.solve(b);
+		return;
+	}
+
+	// Preconditioned CG from the solution with the stored factor
+	double rtol = tol * b.norm();
+	x = ldlt.solve(b);
+	r = b;
+	r.noalias() -= A * x;
+	if (r.norm() <= rtol) {
+		return;
+	}
+	z = ldlt.solve(r);
+	p = z;
+	double rz = r.dot(z);
+	for (int k = 0; k < max_iters; ++k) {
+		num_iters++;
+		Ap.noalias() = A * p;
+		double pAp = p.dot(Ap);
+		if (!(pAp > 0.0)) {
+			break;
+		}
+		double alpha = rz / pAp;
+		x += alpha * p;
+		r -= alpha * Ap;
+		if (r.norm() <= rtol) {
+			return;
+		}
+		z = ldlt.solve(r);
+		double rz_new = r.dot(z);
+		p *= rz_new / rz;
+		p += z;
+		rz = rz_new;
+	}
+
+	// A moved too far from the stored factor
+	factor(A);
+	x = ldlt.solve(b);
+}
+
+void FactorizationCache::print() const {
+	cout << "factorizations " << num_factorizations << " / " << num_solves << " solves, "
+		<< num_iters << " PCG iterations" << endl;
+}
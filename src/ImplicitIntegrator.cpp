@@ -0,0 +1,143 @@
+#include "ImplicitIntegrator.h"
+
+#include "Rigid.h"
+#include "Joint.h"
+#include "Spring.h"
+#include "ArticulatedBody.h"
+#include "ChainKinematics.h"
+#include "FactorizationCache.h"
+#include "QuadProgBox.h"
+
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace Eigen;
+
+ImplicitIntegrator::ImplicitIntegrator(vector< shared_ptr<Rigid> > _boxes, vector< shared_ptr<Joint> > _joints, vector< shared_ptr<Spring> > _springs, bool _isReduced) :
+	num_joints(_boxes.size() - 1),
+	boxes(_boxes),
+	joints(_joints),
+	springs(_springs),
+	isReduced(_isReduced),
+	isJointLimit(false)
+{
+	// Only reduced coordinates
+	assert(isReduced);
+
+	articulated = make_shared<ArticulatedBody>(boxes, joints, springs);
+	chain = ChainKinematicsBase::create(boxes);
+	factorization = make_shared<FactorizationCache>(num_joints, 0.0, 8);
+	qp = make_shared<QuadProgBox>();
+	qp->setNumberOfVariables(num_joints);
+
+	ws.thetalist.resize(num_joints);
+	ws.thetadotlist.resize(num_joints);
+	ws.thetaddotlist.resize(num_joints);
+	ws.v.resize(num_joints);
+	ws.Kv.resize(num_joints);
+	ws.y.resize(num_joints);
+	ws.phi.resize(6 * (int)boxes.size());
+	ws.A.resize(num_joints, num_joints);
+	ws.M_s.resize(num_joints, num_joints);
+	ws.K_s.resize(num_joints, num_joints);
+	ws.lambda.resize(num_joints);
+	ws.VL.resize(num_joints, num_joints);
+	ws.xl.resize(num_joints);
+	ws.xu.resize(num_joints);
+	ws.c.resize(num_joints);
+	ws.eig = SelfAdjointEigenSolver<MatrixXd>(num_joints);
+}
+
+void ImplicitIntegrator::step(double h) {
+	Joint::getThetaVector(joints, ws.thetalist);
+	Joint::getThetadotVector(joints, ws.thetadotlist);
+
+	// Explicit acceleration, all the forces including the elastic one
+	articulated->computeAcceleration(ws.thetalist, ws.thetadotlist, ws.thetaddotlist);
+
+	// H = sum J_i^T M_i J_i + M_s, with the spring inertia the acceleration was solved with
+	chain->update(ws.thetalist);
+	chain->computeMassMatrix(ws.A);
+	articulated->computeSpringMassMatrix(ws.M_s);
+	ws.A += ws.M_s;
+
+	// Where the spring is compressed or wraps around a joint the stiffness is indefinite.
+	// Its negative modes are dropped so that H + h^2 K stays positive definite.
+	Spring::computeStiffnessMatrix(springs, (int)boxes.size(), ws.K_s);
+	ws.eig.compute(ws.K_s);
+	ws.lambda = ws.eig.eigenvalues().cwiseMax(0.0);
+	ws.VL = ws.eig.eigenvectors() * ws.lambda.asDiagonal();
+	ws.K_s.noalias() = ws.VL * ws.eig.eigenvectors().transpose();
+	ws.A += (h * h) * ws.K_s;
+
+	// With tau = H thetaddot the update is
+	// dthetadot = h thetaddot - h^2 (H + h^2 K)^-1 K (thetadot + h thetaddot)
+	ws.v = ws.thetadotlist;
+	ws.v += h * ws.thetaddotlist;
+	ws.Kv.noalias() = ws.K_s * ws.v;
+	factorization->solve(ws.A, ws.Kv, ws.y);
+	ws.v -= (h * h) * ws.y;		// new thetadot
+
+	if (isJointLimit) {
+		applyJointLimits(h);
+	}
+
+	ws.thetalist += h * ws.v;
+	for (int i = 0; i < num_joints; ++i) {
+		joints[i]->setTheta(ws.thetalist(i));
+		joints[i]->setThetadot(ws.v(i));
+	}
+
+	// Twists at the new configuration
+	chain->update(ws.thetalist);
+	chain->computeTwists(ws.v, ws.phi);
+	for (int i = 1; i < (int)boxes.size(); i++) {
+		boxes[i]->setTwist(ws.phi.segment<6>(6 * i));
+	}
+}
+
+void ImplicitIntegrator::applyJointLimits(double h) {
+	double inf = numeric_limits<double>::infinity();
+	bool isQP = false;
+	for (int i = 0; i < num_joints; ++i) {
+		double theta_new = ws.thetalist(i) + h * ws.v(i);
+		ws.xl(i) = -inf;
+		ws.xu(i) = inf;
+		if (theta_new > joints[i]->getMaxTheta()) {
+			// thetadot <= 0.0
+			ws.xu(i) = 0.0;
+			isQP = true;
+		}
+		else if (theta_new < joints[i]->getMinTheta()) {
+			// thetadot >= 0.0
+			ws.xl(i) = 0.0;
+			isQP = true;
+		}
+	}
+	if (!isQP) {
+		return;
+	}
+
+	// min 1/2 v^T A v - (A v*)^T v subject to the limit bounds, v* the unconstrained thetadot
+	ws.c.noalias() = -ws.A * ws.v;
+	qp->setLowerVariableBound(ws.xl);
+	qp->setUpperVariableBound(ws.xu);
+	qp->setObjectiveMatrix(ws.A);
+	qp->setObjectiveVector(ws.c);
+	if (qp->solve()) {
+		ws.v = qp->getPrimalSolution();
+	}
+	else {
+		// Fall back to zeroing the velocities that push past a limit
+		ws.v = ws.v.cwiseMax(ws.xl).cwiseMin(ws.xu);
+	}
+}
+
+void ImplicitIntegrator::setFactorizationTolerance(double tol) {
+	factorization->setTolerance(tol);
+}
+
+ImplicitIntegrator::~ImplicitIntegrator() {
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_IMPLICITINTEGRATOR_H_
+#define MUSCLEMASS_SRC_IMPLICITINTEGRATOR_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class Rigid;
+class Spring;
+class Joint;
+class ArticulatedBody;
+class ChainKinematicsBase;
+class FactorizationCache;
+class QuadProgBox;
+
+// Linearly implicit Euler in reduced coordinates for stiff muscles. Backward Euler is
+// linearized about the current state, with the elastic part of the force treated
+// implicitly through the analytic spring stiffness K = d^2 V_e / dtheta^2:
+// (H + h^2 K) dthetadot = h (tau - h K thetadot), theta += h (thetadot + dthetadot).
+// Joint limits are handled as in SymplecticIntegrator: if the new thetadot would take a
+// joint past its limit, thetadot is found from the box QP with H + h^2 K as the metric.
+class ImplicitIntegrator {
+public:
+	ImplicitIntegrator(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Joint> > _joints, std::vector< std::shared_ptr<Spring> > _springs, bool _isReduced);
+	void step(double h);
+	void setFactorizationTolerance(double tol);
+	void setJointLimit(bool _isJointLimit) { this->isJointLimit = _isJointLimit; }
+	std::shared_ptr<FactorizationCache> getFactorization() const { return this->factorization; }
+	virtual ~ImplicitIntegrator();
+
+	const int num_joints;
+
+private:
+	// Per-step buffers, sized at construction so that step() does not allocate
+	struct Workspace {
+		Eigen::VectorXd thetalist;
+		Eigen::VectorXd thetadotlist;
+		Eigen::VectorXd thetaddotlist;	// explicit acceleration, H^-1 tau
+		Eigen::VectorXd v;				// thetadot + h thetaddot
+		Eigen::VectorXd Kv;
+		Eigen::VectorXd y;
+		Eigen::VectorXd phi;			// box twists
+		Eigen::MatrixXd A;				// H + h^2 K
+		Eigen::MatrixXd M_s;			// spring inertia
+		Eigen::MatrixXd K_s;			// spring stiffness
+		Eigen::VectorXd lambda;			// clamped eigenvalues of K_s
+		Eigen::MatrixXd VL;				// eigenvectors of K_s scaled by lambda
+		Eigen::VectorXd xl;				// QP bounds on the new thetadot
+		Eigen::VectorXd xu;
+		Eigen::VectorXd c;
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig;
+	};
+
+	void applyJointLimits(double h);
+
+	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector< std::shared_ptr<Joint> > joints;
+	std::vector< std::shared_ptr<Spring> > springs;
+	std::shared_ptr<ArticulatedBody> articulated;
+	std::shared_ptr<ChainKinematicsBase> chain;
+	std::shared_ptr<FactorizationCache> factorization;	// LDLT of H + h^2 K reused across steps
+	std::shared_ptr<QuadProgBox> qp;
+	Workspace ws;
+	bool isReduced;
+	bool isJointLimit;
+};
+
+#endif // MUSCLEMASS_SRC_IMPLICITINTEGRATOR_H_
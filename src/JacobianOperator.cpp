@@ -0,0 +1,118 @@
+#include "JacobianOperator.h"
+
+#include "Rigid.h"
+#include "Joint.h"
+
+#include <cassert>
+
+using namespace std;
+using namespace Eigen;
+
+JacobianOperator::JacobianOperator(const vector< shared_ptr<Rigid> > &_boxes) :
+	num_joints((int)_boxes.size() - 1),
+	boxes(_boxes)
+{
+	int nb = (int)boxes.size();
+	parent.resize(nb);
+	Ad_J_P.resize(nb);
+	E_C_J.resize(nb);
+	Ad_C_P.resize(nb);
+	S.resize(nb);
+	F.resize(nb);
+	x_k.resize(cols());
+	phi_k.resize(rows());
+	y_k.resize(cols());
+
+	for (int i = 0; i < nb; ++i) {
+		auto p = boxes[i]->getParent();
+		parent[i] = p ? p->getIndex() : -1;
+		assert(parent[i] < i);
+		if (i > 0) {
+			Ad_J_P[i] = Rigid::adjoint(Rigid::inverse(boxes[i]->getJoint()->getE_P_J()));
+		}
+	}
+	update();
+}
+
+JacobianOperator::~JacobianOperator()
+{
+
+}
+
+void JacobianOperator::setJoint(int i, const Matrix4d &_E_C_J) {
+	// Rotate about Z axis
+	E_C_J[i] = _E_C_J;
+	Matrix6d Ad_C_J = Rigid::adjoint(_E_C_J);
+	Ad_C_P[i] = Ad_C_J * Ad_J_P[i];
+	S[i] = Ad_C_J.col(2);
+}
+
+void JacobianOperator::update() {
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		setJoint(i, boxes[i]->getJoint()->getE_C_J());
+	}
+}
+
+void JacobianOperator::update(const VectorXd &thetalist) {
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		setJoint(i, boxes[i]->getJoint()->computeE_C_J(thetalist(i - 1)));
+	}
+}
+
+void JacobianOperator::multiply(const VectorXd &x, VectorXd &phi) const {
+	// Root to leaves
+	phi.resize(rows());
+	phi.segment<6>(0) = x.segment<6>(0);
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		phi.segment<6>(6 * i).noalias() = Ad_C_P[i] * phi.segment<6>(6 * parent[i]);
+		phi.segment<6>(6 * i) += S[i] * x(5 + i);
+	}
+}
+
+void JacobianOperator::multiplyJoints(const VectorXd &thetadot, VectorXd &phi) const {
+	phi.resize(rows());
+	phi.segment<6>(0).setZero();
+	for (int i = 1; i < (int)boxes.size(); ++i) {
+		phi.segment<6>(6 * i).noalias() = Ad_C_P[i] * phi.segment<6>(6 * parent[i]);
+		phi.segment<6>(6 * i) += S[i] * thetadot(i - 1);
+	}
+}
+
+void JacobianOperator::multiplyTranspose(const VectorXd &f, VectorXd &y) const {
+	// Leaves to root, each box passes its force and its children's on to the parent
+	y.resize(cols());
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		F[i] = f.segment<6>(6 * i);
+	}
+	for (int i = (int)boxes.size() - 1; i > 0; --i) {
+		y(5 + i) = S[i].dot(F[i]);
+		F[parent[i]].noalias() += Ad_C_P[i].transpose() * F[i];
+	}
+	y.segment<6>(0) = F[0];
+}
+
+void JacobianOperator::computeMassMatrix(MatrixXd &A) const {
+	A.resize(num_joints, num_joints);
+	x_k.setZero();
+	for (int k = 0; k < num_joints; ++k) {
+		x_k(6 + k) = 1.0;
+		multiply(x_k, phi_k);
+		x_k(6 + k) = 0.0;
+		for (int i = 0; i < (int)boxes.size(); ++i) {
+			phi_k.segment<6>(6 * i) = boxes[i]->getMassMatrix() * phi_k.segment<6>(6 * i);
+		}
+		multiplyTranspose(phi_k, y_k);
+		A.col(k) = y_k.segment(6, num_joints);
+	}
+}
+
+void JacobianOperator::toDense(MatrixXd &J) const {
+	J.resize(rows(), cols());
+	x_k.setZero();
+	for (int k = 0; k < cols(); ++k) {
+		x_k(k) = 1.0;
+		multiply(x_k, phi_k);
+		x_k(k) = 0.0;
+		J.col(k) = phi_k;
+	}
+}
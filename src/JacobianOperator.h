@@ -0,0 +1,65 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_JACOBIANOPERATOR_H_
+#define MUSCLEMASS_SRC_JACOBIANOPERATOR_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class Rigid;
+
+// The twist Jacobian of a tree of boxes, phi = J [phi_0; thetadot], applied without
+// forming J. The columns are the twist of box 0 followed by one column per joint, as in
+// SymplecticIntegrator::getJ_twist_thetadot().
+// J x is a sweep from the root, phi_C = Ad_C_P phi_P + S thetadot, and J^T f is a sweep
+// from the leaves that accumulates Ad_C_P^T f_C into the parent. Both are O(N).
+// The dense matrix is only built by toDense().
+class JacobianOperator
+{
+public:
+	JacobianOperator(const std::vector< std::shared_ptr<Rigid> > &_boxes);
+	virtual ~JacobianOperator();
+
+	// Adjoints from the current joint transforms
+	void update();
+	// Adjoints at the joint angles thetalist, the joints are not changed
+	void update(const Eigen::VectorXd &thetalist);
+
+	// phi = J x, with x = [phi_0; thetadot]
+	void multiply(const Eigen::VectorXd &x, Eigen::VectorXd &phi) const;
+	// phi = J [0; thetadot], box 0 is fixed
+	void multiplyJoints(const Eigen::VectorXd &thetadot, Eigen::VectorXd &phi) const;
+	// y = J^T f, for body forces f (6 per box)
+	void multiplyTranspose(const Eigen::VectorXd &f, Eigen::VectorXd &y) const;
+	// sum_i J_i^T M_i J_i over the joint columns, one sweep pair per joint
+	void computeMassMatrix(Eigen::MatrixXd &A) const;
+	void toDense(Eigen::MatrixXd &J) const;
+
+	// Per joint quantities at the last update(), for the recursive solvers built on top
+	const Eigen::Matrix4d &getE_C_J(int i) const { return this->E_C_J[i]; }
+	const Matrix6d &getAdjoint(int i) const { return this->Ad_C_P[i]; }
+	const Vector6d &getAxis(int i) const { return this->S[i]; }
+
+	int rows() const { return 6 * (int)this->boxes.size(); }
+	int cols() const { return 6 + this->num_joints; }
+
+	const int num_joints;
+
+private:
+	void setJoint(int i, const Eigen::Matrix4d &_E_C_J);
+
+	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector<int> parent;			// parent box index, -1 for box 0
+	std::vector<Matrix6d> Ad_J_P;		// fixed part of Ad_C_P
+	std::vector<Eigen::Matrix4d> E_C_J;	// where the joint is wrt the child
+	std::vector<Matrix6d> Ad_C_P;		// maps the parent twist into the child frame
+	std::vector<Vector6d> S;			// joint axis in child coords
+	mutable std::vector<Vector6d> F;	// forces accumulated by multiplyTranspose()
+	mutable Eigen::VectorXd x_k;		// workspace for computeMassMatrix()
+	mutable Eigen::VectorXd phi_k;
+	mutable Eigen::VectorXd y_k;
+};
+
+#endif // MUSCLEMASS_SRC_JACOBIANOPERATOR_H_
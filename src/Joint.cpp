@@ -20,27 +20,44 @@ Joint::Joint(Matrix4d _E_P_J, Matrix4d _E_C_J, double _min_theta, double _max_th
 	this->theta = 0.0;
 }
 
-VectorXd Joint::getThetaVector(vector<shared_ptr<Joint>> joints) {
+VectorXd Joint::getThetaVector(const vector<shared_ptr<Joint>> &joints) {
 	VectorXd thetalist;
+	getThetaVector(joints, thetalist);
+	return thetalist;
+}
+
+VectorXd Joint::getThetadotVector(const vector<shared_ptr<Joint>> &joints) {
+	VectorXd thetadotlist;
+	getThetadotVector(joints, thetadotlist);
+	return thetadotlist;
+}
+
+void Joint::getThetaVector(const vector<shared_ptr<Joint>> &joints, VectorXd &thetalist) {
+	// Only reallocates when the number of joints changes
 	thetalist.resize((int)joints.size());
-	thetalist.setZero();
 	for (int i = 0; i < (int)joints.size(); ++i) {
 		thetalist(i) = joints[i]->getTheta();
 	}
-	return thetalist;
 }
 
-VectorXd Joint::getThetadotVector(vector<shared_ptr<Joint>> joints) {
-	VectorXd thetadotlist;
+void Joint::getThetadotVector(const vector<shared_ptr<Joint>> &joints, VectorXd &thetadotlist) {
 	thetadotlist.resize((int)joints.size());
-	thetadotlist.setZero();
 	for (int i = 0; i < (int)joints.size(); ++i) {
 		thetadotlist(i) = joints[i]->getThetadot();
 	}
-	return thetadotlist;
 }
 
-void Joint::setThetadotVector(vector <shared_ptr<Joint>> joints, VectorXd thetadotlist) {	
+Matrix4d Joint::computeE_C_J(const Matrix4d &_E_C_J_0, double _theta) {
+	// E_C_J_0 * Rz(theta)^T, only the first two columns change
+	double c = cos(_theta);
+	double s = sin(_theta);
+	Matrix4d E_C_J = _E_C_J_0;
+	E_C_J.col(0) = c * _E_C_J_0.col(0) - s * _E_C_J_0.col(1);
+	E_C_J.col(1) = s * _E_C_J_0.col(0) + c * _E_C_J_0.col(1);
+	return E_C_J;
+}
+
+void Joint::setThetadotVector(const vector <shared_ptr<Joint>> &joints, const VectorXd &thetadotlist) {	
 	for (int i = 0; i < (int)joints.size(); ++i) {
 		joints[i]->setThetadot(thetadotlist(i));
 	}
@@ -40,18 +40,24 @@ public:
 	double getMinTheta() const { return this->min_theta; }
 	std::shared_ptr<Rigid> getChild() const { return this->child; }
 	std::shared_ptr<Rigid> getParent() const { return this->parent; }
-	static Eigen::VectorXd getThetaVector(std::vector<std::shared_ptr<Joint>> joints);
-	static Eigen::VectorXd getThetadotVector(std::vector<std::shared_ptr<Joint>> joints);
+	static Eigen::VectorXd getThetaVector(const std::vector<std::shared_ptr<Joint>> &joints);
+	static Eigen::VectorXd getThetadotVector(const std::vector<std::shared_ptr<Joint>> &joints);
+	static void getThetaVector(const std::vector<std::shared_ptr<Joint>> &joints, Eigen::VectorXd &thetalist);
+	static void getThetadotVector(const std::vector<std::shared_ptr<Joint>> &joints, Eigen::VectorXd &thetadotlist);
+	// E_C_J at the joint angle theta, the rest pose rotated about the joint Z axis
+	Eigen::Matrix4d computeE_C_J(double _theta) const { return computeE_C_J(this->E_C_J_0, _theta); }
+	static Eigen::Matrix4d computeE_C_J(const Eigen::Matrix4d &_E_C_J_0, double _theta);
 
 	void setE_C_J(Eigen::Matrix4d _E_C_J) { this->E_C_J = _E_C_J; }
 	void setE_P_J(Eigen::Matrix4d _E_P_J) { this->E_P_J = _E_P_J; }
 	void setDTheta(double _dtheta) { this->dtheta = _dtheta; this->theta += _dtheta;}
+	void setTheta(double _theta) { this->dtheta = _theta - this->theta; this->theta = _theta; }
 	void setE_C_J_0(Eigen::Matrix4d _E_C_J_0) { this->E_C_J_0 = _E_C_J_0; }
 	void setE_P_J_0(Eigen::Matrix4d _E_P_J_0) { this->E_P_J_0 = _E_P_J_0; }
 	void setTheta_0(double _theta_0) { this->theta_0 = _theta_0; }
 	void setThetadot(double _thetadot) { this->thetadot = _thetadot; }
 	void setThetaddot(double _thetaddot) { this->thetaddot = _thetaddot; }
-	static void setThetadotVector(std::vector <std::shared_ptr<Joint>> joints, Eigen::VectorXd thetadotlist);
+	static void setThetadotVector(const std::vector <std::shared_ptr<Joint>> &joints, const Eigen::VectorXd &thetadotlist);
 
 	void setChild(std::shared_ptr<Rigid> _child) { this->child = _child; }
 	void setParent(std::shared_ptr<Rigid> _parent) { this->parent = _parent; }
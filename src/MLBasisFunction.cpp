@@ -1,6 +1,8 @@
 #include "MLBasisFunction.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include "MLParametricShape.h"
 #include "MLError.h"
@@ -62,4 +64,137 @@ MLBasisFunction::MLBasisFunction()
 //		}
 //	}
 //	return true;
-//}
\ No newline at end of file
+//}
+
+MLLinearBSpline::MLLinearBSpline(const Eigen::VectorXd &center, const Eigen::VectorXd &support, double weigth)
+{
+	m_center_ = center;
+	m_support_ = support;
+	m_weight_ = weigth;
+}
+
+double MLLinearBSpline::value(double u)
+{
+	return std::max(0.0, 1.0 - std::abs(u));
+}
+
+double MLLinearBSpline::derivative(double u)
+{
+	if (std::abs(u) >= 1.0) {
+		return 0.0;
+	}
+	return u < 0.0 ? 1.0 : -1.0;
+}
+
+MLError MLLinearBSpline::eval(const Eigen::VectorXd &pos, double *result)
+{
+	double r = m_weight_;
+	for (int i = 0; i < (int)m_center_.size(); i++) {
+		r *= value((pos(i) - m_center_(i)) / m_support_(i));
+	}
+	*result = r;
+	return MLError();
+}
+
+MLError MLLinearBSpline::evalDeriv(const Eigen::VectorXd &pos, int direction, double *result)
+{
+	double r = m_weight_;
+	for (int i = 0; i < (int)m_center_.size(); i++) {
+		double u = (pos(i) - m_center_(i)) / m_support_(i);
+		r *= (i == direction) ? derivative(u) / m_support_(i) : value(u);
+	}
+	*result = r;
+	return MLError();
+}
+
+MLError MLLinearBSpline::refine(int dir, std::vector<MLBasisFunction*> *basisFunctions)
+{
+	// A hat is half of its left neighbour, itself and half of its right neighbour at half the width
+	Eigen::VectorXd support = m_support_;
+	support(dir) *= 0.5;
+	const double w[3] = { 0.5, 1.0, 0.5 };
+	for (int k = -1; k <= 1; k++) {
+		Eigen::VectorXd center = m_center_;
+		center(dir) += k * support(dir);
+		basisFunctions->push_back(new MLLinearBSpline(center, support, m_weight_ * w[k + 1]));
+	}
+	return MLError();
+}
+
+void MLLinearBSpline::log()
+{
+	std::cout << "linear bspline center = " << m_center_.transpose() << " support = " << m_support_.transpose() << " weight = " << m_weight_ << std::endl;
+}
+
+MLCubicBSpline::MLCubicBSpline(const Eigen::VectorXd &center, const Eigen::VectorXd &support, double weigth)
+{
+	m_center_ = center;
+	m_support_ = support;
+	m_weight_ = weigth;
+}
+
+double MLCubicBSpline::value(double u)
+{
+	// Uniform cubic B-spline, the support spans four knot intervals
+	double v = 2.0 * std::abs(u);
+	if (v < 1.0) {
+		return (4.0 - 6.0 * v * v + 3.0 * v * v * v) / 6.0;
+	}
+	if (v < 2.0) {
+		return (2.0 - v) * (2.0 - v) * (2.0 - v) / 6.0;
+	}
+	return 0.0;
+}
+
+double MLCubicBSpline::derivative(double u)
+{
+	double v = 2.0 * std::abs(u);
+	double sign = u < 0.0 ? -1.0 : 1.0;
+	if (v < 1.0) {
+		return sign * (-4.0 * v + 3.0 * v * v);
+	}
+	if (v < 2.0) {
+		return -sign * (2.0 - v) * (2.0 - v);
+	}
+	return 0.0;
+}
+
+MLError MLCubicBSpline::eval(const Eigen::VectorXd &pos, double *result)
+{
+	double r = m_weight_;
+	for (int i = 0; i < (int)m_center_.size(); i++) {
+		r *= value((pos(i) - m_center_(i)) / m_support_(i));
+	}
+	*result = r;
+	return MLError();
+}
+
+MLError MLCubicBSpline::evalDeriv(const Eigen::VectorXd &pos, int direction, double *result)
+{
+	double r = m_weight_;
+	for (int i = 0; i < (int)m_center_.size(); i++) {
+		double u = (pos(i) - m_center_(i)) / m_support_(i);
+		r *= (i == direction) ? derivative(u) / m_support_(i) : value(u);
+	}
+	*result = r;
+	return MLError();
+}
+
+MLError MLCubicBSpline::refine(int dir, std::vector<MLBasisFunction*> *basisFunctions)
+{
+	// Cubic B-spline subdivision, (1 4 6 4 1) / 8 at half the knot spacing
+	Eigen::VectorXd support = m_support_;
+	support(dir) *= 0.5;
+	const double w[5] = { 0.125, 0.5, 0.75, 0.5, 0.125 };
+	for (int k = -2; k <= 2; k++) {
+		Eigen::VectorXd center = m_center_;
+		center(dir) += k * 0.5 * support(dir);
+		basisFunctions->push_back(new MLCubicBSpline(center, support, m_weight_ * w[k + 2]));
+	}
+	return MLError();
+}
+
+void MLCubicBSpline::log()
+{
+	std::cout << "cubic bspline center = " << m_center_.transpose() << " support = " << m_support_.transpose() << " weight = " << m_weight_ << std::endl;
+}
@@ -44,7 +44,7 @@ public:
 
 protected:
 	Eigen::VectorXd m_center_;
-	Eigen::VectorXd m_support_;
+	Eigen::VectorXd m_support_;		// half-width of the support in each direction
 	double m_weight_;
 };
 
@@ -58,6 +58,9 @@ public:
 	MLError refine(int dir, std::vector<MLBasisFunction*> *basisFunctions);
 	void log();
 
+	// 1D profile and its slope at u = (x - center) / support, nonzero for |u| < 1
+	static double value(double u);
+	static double derivative(double u);
 };
 
 class MLCubicBSpline : public MLBasisFunction
@@ -70,6 +73,9 @@ public:
 	MLError refine(int dir, std::vector<MLBasisFunction*> *basisFunctions);
 	void log();
 
+	// 1D profile and its slope at u = (x - center) / support, nonzero for |u| < 1
+	static double value(double u);
+	static double derivative(double u);
 };
 
 struct MLBasisFunctionKey
@@ -20,7 +20,7 @@ typedef Eigen::Matrix<double, 5, 6> Matrix5x6d;
 typedef Eigen::Matrix<double, 3, 12> Matrix3x12d;
 typedef Eigen::Matrix<double, 12, 12> Matrix12d;
 
-enum Integrator { RKF45, SYMPLECTIC };
+enum Integrator { RKF45, SYMPLECTIC, IMPLICIT };
 
 // Eigen types to/from GLM types
 glm::mat3 eigen_to_glm(const Eigen::Matrix3d &m);
@@ -3,9 +3,11 @@
 #include <iostream>
 #include <fstream>
 
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -16,7 +18,9 @@
 #include "MLWorld.h"
 #include "Shape.h"
 #include "MatrixStack.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 
 using namespace std;
 using namespace Eigen;
@@ -62,6 +66,7 @@ void MLComp::init() {
 }
 
 void MLComp::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P) {
+#ifndef ML_HEADLESS
 
 	prog->bind();
 	if (m_shape) {
@@ -88,6 +93,7 @@ void MLComp::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program
 	}
 	prog->unbind();
 	// draw box
+#endif
 }
 
 MLError MLComp::getTransformWorld(Eigen::Matrix4d &sToWord, const Eigen::Matrix4d *pToWorld) const {
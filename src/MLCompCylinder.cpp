@@ -4,7 +4,9 @@
 #include <fstream>
 
 #include "MatrixStack.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 
 #include "MLError.h"
 #include "MLBody.h"
@@ -38,7 +40,9 @@ MLError MLCompCylinder::load(const json &elem, std::shared_ptr<MLWorld> world, c
 }
 
 void MLCompCylinder::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 
+#endif
 }
 
 void MLCompCylinder::save(std::ofstream &ofs) {
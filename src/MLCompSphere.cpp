@@ -4,7 +4,9 @@
 #include <fstream>
 
 #include "MatrixStack.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 
 #include "MLError.h"
 #include "MLBody.h"
@@ -37,7 +39,9 @@ MLError MLCompSphere::load(const json &elem, std::shared_ptr<MLWorld> world, con
 }
 
 void MLCompSphere::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 
+#endif
 }
 
 void MLCompSphere::save(std::ofstream &ofs) {
@@ -6,7 +6,9 @@
 #include "MLError.h"
 #include "MLWorld.h"
 #include "MatrixStack.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 
 using json = nlohmann::json;
 
@@ -1,8 +1,10 @@
 #include <iostream>
 
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -10,7 +12,9 @@
 
 #include "Particle.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Rigid.h"
 
@@ -90,6 +94,7 @@ double Particle::computeKineticEnergy(VectorXd phi) {
 
 void Particle::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog) const
 {
+#ifndef ML_HEADLESS
 	if(sphere) {
 		MV->pushMatrix();
 		MV->translate(x(0), x(1), x(2));
@@ -98,4 +103,5 @@ void Particle::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog)
 		sphere->draw(prog);
 		MV->popMatrix();
 	}
+#endif
 }
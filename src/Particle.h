@@ -28,7 +28,7 @@ public:
 
 	std::shared_ptr<Rigid> getParent() const { return this->parent; }
 	Eigen::Vector3d getTempPos() const { return this->x_temp; }
-	Eigen::MatrixXd getJacobianMatrix() const { return this->J; }
+	const Eigen::MatrixXd &getJacobianMatrix() const { return this->J; }
 	double getPotentialEnergy() const { return this->V; }
 	double getKineticEnergy() const { return this->K; }
 
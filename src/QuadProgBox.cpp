@@ -0,0 +1,241 @@
+#include "QuadProgBox.h"
+
+#include <iostream>
+#include <cmath>
+#include <cassert>
+
+using namespace std;
+using namespace Eigen;
+
+QuadProgBox::QuadProgBox() :
+	numVars(0),
+	tol(1e-10),
+	num_iters(0)
+{
+
+}
+
+QuadProgBox::~QuadProgBox()
+{
+
+}
+
+void QuadProgBox::resize(int n)
+{
+	numVars = n;
+	H.setZero(n, n);
+	c.setZero(n);
+	l.setConstant(n, -numeric_limits<double>::infinity());
+	u.setConstant(n, numeric_limits<double>::infinity());
+	x.setZero(n);
+	g.setZero(n);
+	active.assign(n, FREE);
+	free_idx.reserve(n);
+	H_FF.resize(n, n);
+	p_F.resize(n);
+}
+
+void QuadProgBox::setNumberOfVariables(int numVars) {
+	// The working set of the last solve is only meaningful for the same problem size
+	if (numVars != this->numVars) {
+		resize(numVars);
+	}
+}
+
+void QuadProgBox::setNumberOfInequalities(int numIneq) {
+	assert(numIneq == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::setNumberOfEqualities(int numEq) {
+	assert(numEq == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::setObjectiveMatrix(const SparseMatrix<double> & mat) {
+	assert(mat.rows() == numVars && mat.cols() == numVars);
+	H = mat;
+}
+
+void QuadProgBox::setObjectiveMatrix(const MatrixXd & mat) {
+	assert(mat.rows() == numVars && mat.cols() == numVars);
+	H = mat;
+}
+
+void QuadProgBox::setObjectiveVector(const VectorXd & vector) {
+	assert(vector.size() == numVars);
+	c = vector;
+}
+
+void QuadProgBox::setObjectiveConstant(double) {
+	// Does not change the minimizer
+}
+
+void QuadProgBox::setLowerVariableBound(const VectorXd & bounds) {
+	assert(bounds.size() == numVars);
+	l = bounds;
+}
+
+void QuadProgBox::setUpperVariableBound(const VectorXd & bounds) {
+	assert(bounds.size() == numVars);
+	u = bounds;
+}
+
+void QuadProgBox::setInequalityMatrix(const SparseMatrix<double> & mat) {
+	assert(mat.rows() == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::setInequalityVector(const VectorXd & vector) {
+	assert(vector.size() == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::setEqualityMatrix(const SparseMatrix<double> & mat) {
+	assert(mat.rows() == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::setEqualityVector(const VectorXd & vector) {
+	assert(vector.size() == 0 && "QuadProgBox only supports variable bounds");
+}
+
+void QuadProgBox::resetActiveSet() {
+	active.assign(numVars, FREE);
+}
+
+bool QuadProgBox::solve() {
+	int n = numVars;
+	num_iters = 0;
+
+	// Start from the previous working set, keeping only the bounds that still exist.
+	// Free variables start from the previous solution pulled inside the new bounds.
+	for (int i = 0; i < n; ++i) {
+		if (active[i] == AT_LOWER && isfinite(l(i))) {
+			x(i) = l(i);
+		}
+		else if (active[i] == AT_UPPER && isfinite(u(i))) {
+			x(i) = u(i);
+		}
+		else {
+			active[i] = FREE;
+			x(i) = min(max(x(i), l(i)), u(i));
+		}
+	}
+
+	// Each iteration either adds a blocking bound or drops one with the wrong multiplier.
+	// The objective decreases strictly, so the working set never repeats.
+	int max_iters = 10 * n + 10;
+	for (num_iters = 1; num_iters <= max_iters; ++num_iters) {
+		g.noalias() = H * x;
+		g += c;
+
+		// Newton step on the free variables, H_FF p_F = -g_F
+		free_idx.clear();
+		for (int i = 0; i < n; ++i) {
+			if (active[i] == FREE) {
+				free_idx.push_back(i);
+			}
+		}
+		int nf = (int)free_idx.size();
+		double p_max = 0.0;
+		if (nf > 0) {
+			// The free block lives in the leading corner of the n x n buffers, and is
+			// factored in place, so a change of the working set does not reallocate
+			Block<MatrixXd> H_ff = H_FF.topLeftCorner(nf, nf);
+			VectorBlock<VectorXd> p_f = p_F.head(nf);
+			for (int a = 0; a < nf; ++a) {
+				for (int b = 0; b < nf; ++b) {
+					H_ff(a, b) = H(free_idx[a], free_idx[b]);
+				}
+				p_f(a) = -g(free_idx[a]);
+			}
+			LLT< Ref<MatrixXd> > llt(H_ff);
+			if (llt.info() != Success) {
+				return false;
+			}
+			llt.solveInPlace(p_f);
+			p_max = p_f.lpNorm<Infinity>();
+		}
+
+		if (p_max <= tol * (1.0 + x.lpNorm<Infinity>())) {
+			// Stationary on the working set, release the bound with the most negative multiplier
+			int j = -1;
+			double worst = -tol * (1.0 + g.lpNorm<Infinity>());
+			for (int i = 0; i < n; ++i) {
+				double lambda = (active[i] == AT_LOWER) ? g(i) : (active[i] == AT_UPPER) ? -g(i) : 0.0;
+				if (lambda < worst) {
+					worst = lambda;
+					j = i;
+				}
+			}
+			if (j < 0) {
+				return true;
+			}
+			active[j] = FREE;
+			continue;
+		}
+
+		// Go as far along p as the bounds allow
+		double alpha = 1.0;
+		int block = -1;
+		int side = FREE;
+		for (int a = 0; a < nf; ++a) {
+			int i = free_idx[a];
+			if (p_F(a) < 0.0 && isfinite(l(i))) {
+				double t = (l(i) - x(i)) / p_F(a);
+				if (t < alpha) {
+					alpha = t;
+					block = i;
+					side = AT_LOWER;
+				}
+			}
+			else if (p_F(a) > 0.0 && isfinite(u(i))) {
+				double t = (u(i) - x(i)) / p_F(a);
+				if (t < alpha) {
+					alpha = t;
+					block = i;
+					side = AT_UPPER;
+				}
+			}
+		}
+		for (int a = 0; a < nf; ++a) {
+			x(free_idx[a]) += alpha * p_F(a);
+		}
+		if (block >= 0) {
+			active[block] = side;
+			x(block) = (side == AT_LOWER) ? l(block) : u(block);
+		}
+	}
+
+	cout << "QuadProgBox: no convergence after " << max_iters << " iterations" << endl;
+	return false;
+}
+
+VectorXd QuadProgBox::getPrimalSolution() {
+	return x;
+}
+
+VectorXd QuadProgBox::getDualInequality() {
+	return VectorXd::Zero(0);
+}
+
+VectorXd QuadProgBox::getDualEquality() {
+	return VectorXd::Zero(0);
+}
+
+VectorXd QuadProgBox::getDualLower() {
+	// Multipliers are nonnegative, as in quadprog's lambda.lower
+	VectorXd y = VectorXd::Zero(numVars);
+	for (int i = 0; i < numVars; ++i) {
+		if (active[i] == AT_LOWER) {
+			y(i) = max(g(i), 0.0);
+		}
+	}
+	return y;
+}
+
+VectorXd QuadProgBox::getDualUpper() {
+	VectorXd y = VectorXd::Zero(numVars);
+	for (int i = 0; i < numVars; ++i) {
+		if (active[i] == AT_UPPER) {
+			y(i) = max(-g(i), 0.0);
+		}
+	}
+	return y;
+}
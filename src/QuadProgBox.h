@@ -0,0 +1,73 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_QUADPROGBOX_H_
+#define MUSCLEMASS_SRC_QUADPROGBOX_H_
+#include "QuadProg.h"
+
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+// Primal active-set solver for min 1/2 x^T H x + c^T x subject to l <= x <= u,
+// with H symmetric positive definite. Only variable bounds are supported, so it
+// covers the joint limit problem without an external solver.
+// The working set (which variables sit on which bound) is kept between solves and
+// is the starting guess of the next one. Across time steps the same limits stay
+// active, so a solve usually ends after one Newton step on the free variables.
+class QuadProgBox : public QuadProg
+{
+public:
+	QuadProgBox();
+	virtual ~QuadProgBox();
+
+	virtual void setNumberOfVariables(int numVars);
+	virtual void setNumberOfInequalities(int numIneq);
+	virtual void setNumberOfEqualities(int numEq);
+
+	virtual void setObjectiveMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setObjectiveVector(const Eigen::VectorXd & vector);
+	virtual void setObjectiveConstant(double constant);
+
+	virtual void setLowerVariableBound(const Eigen::VectorXd & bounds);
+	virtual void setUpperVariableBound(const Eigen::VectorXd & bounds);
+
+	virtual void setInequalityMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setInequalityVector(const Eigen::VectorXd & vector);
+
+	virtual void setEqualityMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setEqualityVector(const Eigen::VectorXd & vector);
+
+	virtual bool solve();
+
+	virtual Eigen::VectorXd getPrimalSolution();
+	virtual Eigen::VectorXd getDualInequality();
+	virtual Eigen::VectorXd getDualEquality();
+	virtual Eigen::VectorXd getDualLower();
+	virtual Eigen::VectorXd getDualUpper();
+
+	void setObjectiveMatrix(const Eigen::MatrixXd & mat);
+	void setTolerance(double _tol) { this->tol = _tol; }
+	void resetActiveSet();
+	int getNumIterations() const { return this->num_iters; }
+
+private:
+	enum { FREE = 0, AT_LOWER = -1, AT_UPPER = 1 };
+
+	void resize(int n);
+
+	int numVars;
+	double tol;
+	int num_iters;
+	Eigen::MatrixXd H;
+	Eigen::VectorXd c;
+	Eigen::VectorXd l;
+	Eigen::VectorXd u;
+	Eigen::VectorXd x;
+	Eigen::VectorXd g;			// gradient H x + c
+	std::vector<int> active;	// working set, FREE, AT_LOWER or AT_UPPER per variable
+	std::vector<int> free_idx;
+	Eigen::MatrixXd H_FF;		// H restricted to the free variables, in the leading corner
+	Eigen::VectorXd p_F;		// Newton step on the free variables, in the leading entries
+};
+
+#endif // MUSCLEMASS_SRC_QUADPROGBOX_H_
@@ -2,52 +2,149 @@
 
 #include "Rigid.h"
 #include "Joint.h"
-#include "MatlabDebug.h"
 #include "Spring.h"
-#include "Particle.h"
+#include "ArticulatedBody.h"
+#include "ChainKinematics.h"
+#include "EmbeddedRK.h"
+#include "QuadProgBox.h"
 
 #include <iostream>
-#include <iomanip>
-
-# include <cstdlib>
-
-# include <iomanip>
-# include <cmath>
-# include <ctime>
+#include <limits>
 
 using namespace std;
 using namespace Eigen;
-#include <unsupported/Eigen/MatrixFunctions> // TODO: avoid using this later, write a func instead
 
-RKF45Integrator::RKF45Integrator(vector< shared_ptr<Rigid> > _boxes, vector< shared_ptr<Spring> > _springs, bool _isReduced) :
+RKF45Integrator::RKF45Integrator(vector< shared_ptr<Rigid> > _boxes, vector< shared_ptr<Joint> > _joints, vector< shared_ptr<Spring> > _springs, bool _isReduced) :
 	num_joints(_boxes.size() - 1),
 	boxes(_boxes),
+	joints(_joints),
 	springs(_springs),
 	isReduced(_isReduced),
-	epsilon(1e-8),
-	grav(0.0, -9.8, 0.0)
+	isJointLimit(false),
+	isInit(false),
+	t(0.0)
 {
+	// Only reduced coordinates, the maximal state does not live in a vector space
+	assert(isReduced);
+
+	dynamics.articulated = make_shared<ArticulatedBody>(boxes, joints, springs);
+	dynamics.thetalist.resize(num_joints);
+	dynamics.thetadotlist.resize(num_joints);
+	dynamics.thetaddotlist.resize(num_joints);
+	rk = make_shared< EmbeddedRK<Dynamics> >(dynamics, 2 * num_joints);
+	chain = ChainKinematicsBase::create(boxes);
+	qp = make_shared<QuadProgBox>();
+	qp->setNumberOfVariables(num_joints);
+
+	y.resize(2 * num_joints);
+	y_out.resize(2 * num_joints);
+	phi.resize(6 * (int)boxes.size());
+	A.resize(num_joints, num_joints);
+	M_s.resize(num_joints, num_joints);
+	xl.resize(num_joints);
+	xu.resize(num_joints);
+	c.resize(num_joints);
+}
+
+void RKF45Integrator::Dynamics::operator()(double, const VectorXd &y, VectorXd &yp) {
+	int n = (int)thetalist.size();
+	thetalist = y.head(n);
+	thetadotlist = y.tail(n);
+	articulated->computeAcceleration(thetalist, thetadotlist, thetaddotlist);
+	yp.head(n) = thetadotlist;
+	yp.tail(n) = thetaddotlist;
+}
+
+void RKF45Integrator::setTolerance(double _abserr, double _relerr) {
+	rk->setTolerance(_abserr, _relerr);
+}
+
+int RKF45Integrator::getNumSteps() const { return rk->getNumSteps(); }
+int RKF45Integrator::getNumRejected() const { return rk->getNumRejected(); }
+int RKF45Integrator::getNumEvaluations() const { return rk->getNumEvaluations(); }
+
+void RKF45Integrator::step(double h) {
+	Joint::getThetaVector(joints, dynamics.thetalist);
+	Joint::getThetadotVector(joints, dynamics.thetadotlist);
+	y.head(num_joints) = dynamics.thetalist;
+	y.tail(num_joints) = dynamics.thetadotlist;
+
+	// Restart if the joints were changed from outside since the last frame
+	if (!isInit || y != y_out) {
+		rk->init(t, y);
+		isInit = true;
+	}
+
+	t += h;
+	rk->integrate(t, y_out);
+
+	dynamics.thetalist = y_out.head(num_joints);
+	dynamics.thetadotlist = y_out.tail(num_joints);
+	if (isJointLimit && applyJointLimits()) {
+		// The dense output no longer matches the state, start over from the limit
+		y_out.head(num_joints) = dynamics.thetalist;
+		y_out.tail(num_joints) = dynamics.thetadotlist;
+		rk->init(t, y_out);
+	}
+	for (int i = 0; i < num_joints; ++i) {
+		joints[i]->setTheta(dynamics.thetalist(i));
+		joints[i]->setThetadot(dynamics.thetadotlist(i));
+	}
+
+	// Twists at the sampled state
+	chain->update(dynamics.thetalist);
+	chain->computeTwists(dynamics.thetadotlist, phi);
+	for (int i = 1; i < (int)boxes.size(); i++) {
+		boxes[i]->setTwist(phi.segment<6>(6 * i));
+	}
+}
+
+bool RKF45Integrator::applyJointLimits() {
+	double inf = numeric_limits<double>::infinity();
+	bool isQP = false;
+	for (int i = 0; i < num_joints; ++i) {
+		double min_theta = joints[i]->getMinTheta();
+		double max_theta = joints[i]->getMaxTheta();
+		xl(i) = -inf;
+		xu(i) = inf;
+		if (dynamics.thetalist(i) > max_theta) {
+			// thetadot <= 0.0
+			dynamics.thetalist(i) = max_theta;
+			xu(i) = 0.0;
+			isQP = true;
+		}
+		else if (dynamics.thetalist(i) < min_theta) {
+			// thetadot >= 0.0
+			dynamics.thetalist(i) = min_theta;
+			xl(i) = 0.0;
+			isQP = true;
+		}
+	}
+	if (!isQP) {
+		return false;
+	}
 
-	if (isReduced) {
-		m = 6 * (int)boxes.size();
-		n = 6 + 1 * ((int)boxes.size() - 1);
-		M.resize(m, m);
-		J.resize(m, n);
-		f.resize(m);
-		M.setZero();
-		J.setZero();
-		f.setZero();
+	// min 1/2 v^T A v - (A v*)^T v subject to the limit bounds, v* the integrated thetadot
+	chain->update(dynamics.thetalist);
+	chain->computeMassMatrix(A);
+	Spring::computeMassMatrix(springs, (int)boxes.size(), isReduced, M_s);
+	A += M_s;
+	c.noalias() = -A * dynamics.thetadotlist;
 
+	qp->setLowerVariableBound(xl);
+	qp->setUpperVariableBound(xu);
+	qp->setObjectiveMatrix(A);
+	qp->setObjectiveVector(c);
+	if (qp->solve()) {
+		dynamics.thetadotlist = qp->getPrimalSolution();
 	}
 	else {
-		n = 6 * (int)boxes.size() + 6 + 5 * ((int)boxes.size() - 1);
+		// Fall back to zeroing the velocities that push past a limit
+		dynamics.thetadotlist = dynamics.thetadotlist.cwiseMax(xl).cwiseMin(xu);
 	}
+	return true;
+}
 
-	A.resize(n, n);
-	x.resize(n);
-	b.resize(n);
+RKF45Integrator::~RKF45Integrator() {
 
-	A.setZero();
-	x.setZero();
-	b.setZero();
-}
\ No newline at end of file
+}
@@ -10,30 +10,60 @@
 
 class Rigid;
 class Spring;
-class Particle;
+class Joint;
+class ArticulatedBody;
+class ChainKinematicsBase;
+class QuadProgBox;
+template <class RHS> class EmbeddedRK;
 
+// Adaptive RKF45 time stepping in reduced coordinates, y = [theta; thetadot].
+// The accelerations come from the articulated-body algorithm. The internal steps are
+// chosen by the error control alone and the state at the end of each frame is read from
+// the dense output, so the frame size h does not clip the steps.
 class RKF45Integrator {
 public:
-	RKF45Integrator(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Spring> > _springs, bool _isReduced);
+	RKF45Integrator(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Joint> > _joints, std::vector< std::shared_ptr<Spring> > _springs, bool _isReduced);
+	void step(double h);
+	void setTolerance(double _abserr, double _relerr);
+	void setJointLimit(bool _isJointLimit) { this->isJointLimit = _isJointLimit; }
+	int getNumSteps() const;
+	int getNumRejected() const;
+	int getNumEvaluations() const;
+	virtual ~RKF45Integrator();
 
-	double m;
-	double n;
 	const int num_joints;
 
 private:
+	// y' = f(t, y)
+	struct Dynamics {
+		std::shared_ptr<ArticulatedBody> articulated;
+		Eigen::VectorXd thetalist;
+		Eigen::VectorXd thetadotlist;
+		Eigen::VectorXd thetaddotlist;
+		void operator()(double t, const Eigen::VectorXd &y, Eigen::VectorXd &yp);
+	};
+
 	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector< std::shared_ptr<Joint> > joints;
 	std::vector< std::shared_ptr<Spring> > springs;
+	bool applyJointLimits();
 
-	Eigen::MatrixXd A;
-	Eigen::MatrixXd M;
-	Eigen::MatrixXd J;
-	Eigen::VectorXd x;
-	Eigen::VectorXd b;
-	Eigen::VectorXd f;
-	double epsilon;
+	Dynamics dynamics;
+	std::shared_ptr< EmbeddedRK<Dynamics> > rk;
+	std::shared_ptr<ChainKinematicsBase> chain;
+	std::shared_ptr<QuadProgBox> qp;
 	bool isReduced;
-	Eigen::Vector3d grav;
-
+	bool isJointLimit;
+	bool isInit;		// rk holds the current state
+	double t;
+	Eigen::VectorXd y;		// state read from the joints
+	Eigen::VectorXd y_out;	// state written to the joints
+	Eigen::VectorXd phi;	// box twists
+	Eigen::MatrixXd A;		// joint-space inertia, for the limit projection
+	Eigen::MatrixXd M_s;	// spring inertia
+	Eigen::VectorXd xl;		// velocity bounds of the limit projection
+	Eigen::VectorXd xu;
+	Eigen::VectorXd c;
 };
 
 #endif // MUSLEMASS_SRC_RKF45INTEGRATOR
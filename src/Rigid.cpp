@@ -1,17 +1,22 @@
 #include <iostream>
 #include <math.h> // atan
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Rigid.h"
+#include "SE3.h"
 
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "WrapSphere.h"
 #include "WrapCylinder.h"
@@ -102,10 +107,27 @@ void Rigid::step(double h) {
 		this->joint->setE_C_J(E_C_J);
 	}
 	
+	// The wrap inputs are points, so they move first
+	updatePoints();
+	updateSpheres();
+	updateCylinders();
+	updateDoubleCylinders();
+}
+
+void Rigid::correct(const Vector6d &dx) {
+	// Same updates as step(), for a pose change that does not come from the twist
+	this->E_W_0 = E_W_0 * SE3::exp(dx);
+	computeForces();
+	computeEnergy();
+	if (i != 0) {
+		Matrix4d E_C_J = getE().inverse() * parent->getE() * joint->getE_P_J();
+		this->joint->setE_C_J(E_C_J);
+	}
+
+	updatePoints();
 	updateSpheres();
 	updateCylinders();
 	updateDoubleCylinders();
-	updatePoints();	
 }
 
 void Rigid::computeEnergy() {
@@ -173,6 +195,37 @@ void Rigid::setJointAngle(double _theta, bool isDrawing) {
 	}
 }
 
+MatrixXd Rigid::computePointJacobian(const Vector3d &x0, int num_joints) const {
+	MatrixXd J;
+	computePointJacobian(x0, num_joints, J);
+	return J;
+}
+
+void Rigid::computePointJacobian(const Vector3d &x0, int num_joints, MatrixXd &J) const {
+	// Only used in reduced coord. Jacobian of a point fixed on this body (x0 in body coords)
+	// wrt the joint angles, column i - 1 belongs to the joint of box i.
+	J.resize(3, num_joints);
+	J.setZero();
+
+	// Rotate about Z axis
+	Vector6d z;
+	z.setZero();
+	z(2) = 1.0;
+
+	// World velocity of the point is R * gamma(x0) * phi, where phi is the body twist
+	Matrix3x6d G = getR() * gamma(x0);
+	Matrix4d E_0_W = inverse(this->E_W_0);
+
+	// Every joint on the way down to the root contributes a column
+	const Rigid *box = this;
+	while (box->getIndex() != 0) {
+		auto joint = box->getJoint();
+		Matrix4d E_W_J = box->getParent()->getE() * joint->getE_P_J();
+		J.col(box->getIndex() - 1) = G * adjoint(E_0_W * E_W_J) * z;
+		box = box->getParent().get();
+	}
+}
+
 void Rigid::updateCylinders() {
 	if (isCylinder) {
 		for (int i = 0; i < (int)cylinders.size(); i++) {
@@ -220,6 +273,7 @@ void Rigid::updatePoints() {
 
 void Rigid::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> prog2, shared_ptr<MatrixStack> P) const
 {
+#ifndef ML_HEADLESS
 	prog->bind();
 	if (box) {
 		glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
@@ -271,17 +325,12 @@ void Rigid::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, con
 			double_cylinders[i]->draw(MV, prog, prog2, P);
 		}
 	}
+#endif
 }
 
 Matrix4d Rigid::inverse(const Matrix4d &E)
 {
-	Matrix4d Einv = Matrix4d::Identity();
-	Matrix3d R = E.block<3, 3>(0, 0);
-	Vector3d p = E.block<3, 1>(0, 3);
-	Matrix3d Rt = R.transpose();
-	Einv.block<3, 3>(0, 0) = Rt;
-	Einv.block<3, 1>(0, 3) = -Rt * p;
-	return Einv;
+	return SE3::inverse(E);
 }
 
 Matrix3x6d Rigid::gamma(const Eigen::Vector3d &r)
@@ -294,13 +343,7 @@ Matrix3x6d Rigid::gamma(const Eigen::Vector3d &r)
 
 Matrix6d Rigid::adjoint(const Matrix4d &E)
 {
-	Matrix6d Ad = Matrix6d::Zero();
-	Matrix3d R = E.block<3, 3>(0, 0);
-	Vector3d p = E.block<3, 1>(0, 3);
-	Ad.block(0, 0, 3, 3) = R;
-	Ad.block(3, 0, 3, 3) = bracket3(p) * R;
-	Ad.block(3, 3, 3, 3) = R;
-	return Ad;
+	return SE3::adjoint(E);
 }
 
 Matrix3d Rigid::bracket3(const Vector3d &a)
@@ -342,39 +385,10 @@ Vector6d Rigid::unbracket6(const Matrix4d &A)
 	return a;
 }
 
-Matrix4d Rigid::integrate(const Matrix4d &E0, const VectorXd &phi, double h)
+Matrix4d Rigid::integrate(const Matrix4d &E0, const Vector6d &phi, double h)
 {
-	Matrix3d I = Matrix3d::Identity();
-	Vector3d w = phi.segment<3>(0);
-	Vector3d v = phi.segment<3>(3);
-	Matrix4d phib = Matrix4d::Identity();
-	phib.block<3, 1>(0, 3) = h*v;
-	double wlen = w.norm();
-	if (wlen > 1e-10) {
-		w /= wlen;
-		v /= wlen;
-		// Rodrigues formula %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-		double wX = w(0);
-		double wY = w(1);
-		double wZ = w(2);
-		double c = cos(wlen * h);
-		double s = sin(wlen * h);
-		double c1 = 1.0 - c;
-		Matrix3d R;
-		R << c + wX * wX * c1, -wZ * s + wX * wY * c1, wY * s + wX * wZ * c1,
-			wZ * s + wX * wY * c1, c + wY * wY * c1, -wX * s + wY * wZ * c1,
-			-wY * s + wX * wZ * c1, wX * s + wY * wZ * c1, c + wZ * wZ * c1;
-		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-		Matrix3d A = I - R;
-		Vector3d cc = w.cross(v);
-		Vector3d d = A * cc;
-		double wv = w.dot(v);
-		Vector3d p = (wv * wlen * h) * w + d;
-		phib.block<3, 3>(0, 0) = R;
-		phib.block<3, 1>(0, 3) = p;
-		//cout << phib << endl;
-	}
-	return E0 * phib;
+	Vector6d xi = h * phi;
+	return E0 * SE3::exp(xi);
 }
 
 void Rigid::computeForces() {
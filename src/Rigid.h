@@ -30,6 +30,7 @@ public:
 	void tare();
 	void reset();
 	void step(double h);
+	void correct(const Vector6d &dx);	// Move by the body displacement dx, the parent must be up to date
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
 	void computeForces();	  // Use current E
 	void computeEnergy();
@@ -90,6 +91,8 @@ public:
 	std::shared_ptr<Joint> getJoint() const { return this->joint; }
 	std::vector<std::shared_ptr<Particle>> getPoints() const { return this->points; }
 	int getIndex() const{ return this->i; }
+	Eigen::MatrixXd computePointJacobian(const Eigen::Vector3d &x0, int num_joints) const;
+	void computePointJacobian(const Eigen::Vector3d &x0, int num_joints, Eigen::MatrixXd &J) const;
 
 	static Eigen::Matrix4d inverse(const Eigen::Matrix4d &E);
 	static Matrix3x6d gamma(const Eigen::Vector3d &r);
@@ -98,7 +101,7 @@ public:
 	static Eigen::Matrix4d bracket6(const Vector6d &a);
 	static Eigen::Vector3d unbracket3(const Eigen::Matrix3d &A);
 	static Vector6d unbracket6(const Eigen::Matrix4d &A);
-	static Eigen::Matrix4d integrate(const Eigen::Matrix4d &E0, const Eigen::VectorXd &phi, double h);
+	static Eigen::Matrix4d integrate(const Eigen::Matrix4d &E0, const Vector6d &phi, double h);
 
 	double r; // radius
 	double m; // mass
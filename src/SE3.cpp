@@ -0,0 +1,153 @@
+#include "SE3.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace Eigen;
+
+// Below this angle the closed forms divide by zero, the series are exact there
+static const double SMALL_ANGLE = 1e-4;
+// t - sin(t) cancels to t^3 / 6 and loses about log10(6 / t^2) digits, so C takes its
+// series up to this angle, where at most 1.4 digits are lost
+static const double SERIES_ANGLE = 0.5;
+
+void SE3::coefficients(double t, double &A, double &B, double &C)
+{
+	double t2 = t * t;
+	if (t < SMALL_ANGLE) {
+		A = 1.0 - t2 / 6.0 * (1.0 - t2 / 20.0);
+		B = 0.5 - t2 / 24.0 * (1.0 - t2 / 30.0);
+	}
+	else {
+		// 1 - cos(t) = 2 sin^2(t/2) has no cancellation
+		double s2 = sin(0.5 * t) / t;
+		A = sin(t) / t;
+		B = 2.0 * s2 * s2;
+	}
+	if (t < SERIES_ANGLE) {
+		// C = sum_k (-t^2)^k / (2k + 3)!, the first left out term is below 1e-18
+		C = 1.0 / 6.0 - t2 / 120.0 * (1.0 - t2 / 42.0 * (1.0 - t2 / 72.0 * (1.0 - t2 / 110.0 * (1.0 - t2 / 156.0 * (1.0 - t2 / 210.0)))));
+	}
+	else {
+		C = (t - sin(t)) / (t2 * t);
+	}
+}
+
+Matrix3d SE3::bracket3(const Vector3d &a)
+{
+	Matrix3d A;
+	A << 0.0, -a(2), a(1),
+		a(2), 0.0, -a(0),
+		-a(1), a(0), 0.0;
+	return A;
+}
+
+Matrix4d SE3::bracket6(const Vector6d &a)
+{
+	Matrix4d A = Matrix4d::Zero();
+	A.block<3, 3>(0, 0) = bracket3(a.segment<3>(0));
+	A.block<3, 1>(0, 3) = a.segment<3>(3);
+	return A;
+}
+
+Matrix3d SE3::expSO3(const Vector3d &w)
+{
+	// Rodrigues, R = I + A [w] + B [w]^2
+	double A, B, C;
+	coefficients(w.norm(), A, B, C);
+	Matrix3d W = bracket3(w);
+	return Matrix3d::Identity() + A * W + B * W * W;
+}
+
+Vector3d SE3::logSO3(const Matrix3d &R)
+{
+	// atan2 keeps the angle accurate near the identity, where acos is not
+	Vector3d v(R(2, 1) - R(1, 2), R(0, 2) - R(2, 0), R(1, 0) - R(0, 1));
+	double s = 0.5 * v.norm();
+	double c = 0.5 * (R.trace() - 1.0);
+	double t = atan2(s, c);
+
+	if (t < SMALL_ANGLE) {
+		// t / (2 sin(t)) = 1/2 + t^2/12 + ...
+		return (0.5 + t * t / 12.0) * v;
+	}
+	if (M_PI - t < SMALL_ANGLE) {
+		// sin(t) ~ 0, so v only gives the sign of the axis. The symmetric part is
+		// (R + R^T) / 2 = c I + (1 - c) a a^T, take a from its largest column.
+		Matrix3d S = 0.5 * (R + R.transpose());
+		S.diagonal().array() -= c;
+		int k;
+		S.diagonal().maxCoeff(&k);
+		Vector3d axis = S.col(k) / sqrt((1.0 - c) * S(k, k));
+		if (axis.dot(v) < 0.0) {
+			axis = -axis;
+		}
+		return t * axis;
+	}
+	return t / (2.0 * s) * v;
+}
+
+Matrix4d SE3::exp(const Vector6d &xi)
+{
+	// E = [R V v; 0 1], with V = I + B [w] + C [w]^2
+	Vector3d w = xi.segment<3>(0);
+	Vector3d v = xi.segment<3>(3);
+	double A, B, C;
+	coefficients(w.norm(), A, B, C);
+	Matrix3d W = bracket3(w);
+	Matrix3d W2 = W * W;
+
+	Matrix4d E = Matrix4d::Identity();
+	E.block<3, 3>(0, 0) += A * W + B * W2;
+	E.block<3, 1>(0, 3) = v + B * (W * v) + C * (W2 * v);
+	return E;
+}
+
+Vector6d SE3::log(const Matrix4d &E)
+{
+	// v = V^-1 p, with V^-1 = I - 1/2 [w] + D [w]^2 and D = (1 - A / (2 B)) / t^2
+	Vector3d w = logSO3(E.block<3, 3>(0, 0));
+	Vector3d p = E.block<3, 1>(0, 3);
+	double t = w.norm();
+	double D;
+	if (t < SERIES_ANGLE) {
+		// 1 - A / (2 B) = 1 - (t/2) cot(t/2) cancels, D = sum_n |B_2n| / (2n)! t^(2n-2)
+		// with the Bernoulli numbers B_2n, up to t^12
+		double t2 = t * t;
+		D = 1.0 / 12.0 + t2 * (1.0 / 720.0 + t2 * (1.0 / 30240.0 + t2 * (1.0 / 1209600.0
+			+ t2 * (1.0 / 47900160.0 + t2 * (691.0 / 1307674368000.0 + t2 * (1.0 / 74724249600.0))))));
+	}
+	else {
+		double A, B, C;
+		coefficients(t, A, B, C);
+		D = (1.0 - A / (2.0 * B)) / (t * t);
+	}
+	Matrix3d W = bracket3(w);
+	Vector3d Wp = W * p;
+
+	Vector6d xi;
+	xi.segment<3>(0) = w;
+	xi.segment<3>(3) = p - 0.5 * Wp + D * (W * Wp);
+	return xi;
+}
+
+Matrix6d SE3::adjoint(const Matrix4d &E)
+{
+	Matrix6d Ad;
+	Matrix3d R = E.block<3, 3>(0, 0);
+	Ad.block<3, 3>(0, 0) = R;
+	Ad.block<3, 3>(0, 3).setZero();
+	Ad.block<3, 3>(3, 0) = bracket3(E.block<3, 1>(0, 3)) * R;
+	Ad.block<3, 3>(3, 3) = R;
+	return Ad;
+}
+
+Matrix4d SE3::inverse(const Matrix4d &E)
+{
+	Matrix4d Einv = Matrix4d::Identity();
+	Matrix3d Rt = E.block<3, 3>(0, 0).transpose();
+	Einv.block<3, 3>(0, 0) = Rt;
+	Einv.block<3, 1>(0, 3) = -Rt * E.block<3, 1>(0, 3);
+	return Einv;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_SE3_H_
+#define MUSCLEMASS_SRC_SE3_H_
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+// Closed-form Lie group operations on SE(3), with twists ordered [w; v] as in Rigid.
+// Near the identity the trigonometric coefficients are replaced by their Taylor series,
+// so exp() and log() stay accurate for small rotations.
+class SE3
+{
+public:
+	static Eigen::Matrix3d expSO3(const Eigen::Vector3d &w);
+	static Eigen::Vector3d logSO3(const Eigen::Matrix3d &R);
+	static Eigen::Matrix4d exp(const Vector6d &xi);
+	static Vector6d log(const Eigen::Matrix4d &E);
+	static Matrix6d adjoint(const Eigen::Matrix4d &E);
+	static Eigen::Matrix4d inverse(const Eigen::Matrix4d &E);
+	static Eigen::Matrix3d bracket3(const Eigen::Vector3d &a);
+	static Eigen::Matrix4d bracket6(const Vector6d &a);
+
+private:
+	// A = sin(t)/t, B = (1 - cos(t))/t^2, C = (t - sin(t))/t^3
+	static void coefficients(double t, double &A, double &B, double &C);
+};
+
+#endif // MUSCLEMASS_SRC_SE3_H_
@@ -6,11 +6,15 @@
 
 #include "Particle.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "Rigid.h"
 #include "WrapSphere.h"
 #include "WrapCylinder.h"
 #include "WrapDoubleCylinder.h"
+#include "WrapTable.h"
+#include "WrapBatch.h"
 #include "Joint.h"
 #include "MatlabDebug.h"
 #include "Vector.h"
@@ -18,16 +22,22 @@
 #include "Spring.h"
 #include "SymplecticIntegrator.h"
 #include "RKF45Integrator.h"
+#include "ImplicitIntegrator.h"
+#include "FactorizationCache.h"
+#include "StepController.h"
 #include "Solver.h"
+#include "AllocationCounter.h"
+#include "SE3.h"
 
 using namespace std;
 using namespace Eigen;
 using json = nlohmann::json;
 
-#include <unsupported/Eigen/MatrixFunctions> // TODO: avoid using this later, write a func instead
 
 Scene::Scene() :
 	t(0.0),
+	drift(0.0),
+	step_allocs(0),
 	h(1e-2),
 	step_i(0),
 	grav(0.0, 0.0, 0.0),
@@ -35,7 +45,10 @@ Scene::Scene() :
 	t_stop(100.0),
 	n_step(10000),
 	K(0.0),
-	V(0.0)
+	V(0.0),
+	isReduced(true),
+	isPlotEnergy(false),
+	plot_steps(0)
 {
 	theta_list.resize(n_step * 2);
 }
@@ -44,7 +57,17 @@ Scene::~Scene()
 {
 }
 
-void Scene::load(const string &RESOURCE_DIR)
+void Scene::load(const string &RESOURCE_DIR, const string &JSON_FILE)
+{
+	//read a JSON file
+	json _js;
+	ifstream i(RESOURCE_DIR + JSON_FILE);
+	i >> _js;
+	i.close();
+	loadFromJson(RESOURCE_DIR, _js);
+}
+
+void Scene::loadFromJson(const string &RESOURCE_DIR, const json &_js)
 {	
 	// Init shapes
 	boxShape = make_shared<Shape>();
@@ -54,15 +77,30 @@ void Scene::load(const string &RESOURCE_DIR)
 	cylinderShape = make_shared<Shape>();
 	cylinderShape->loadMesh(RESOURCE_DIR + "cylinder2.obj");
 
-	//read a JSON file
-	ifstream i(RESOURCE_DIR + "input.json");
-	i >> js;
-	i.close();
+	js = _js;
 
 	// Units: meters, kilograms, seconds
 	h = js["h"];
 	Eigen::from_json(js["grav"], grav);
 	time_integrator = SYMPLECTIC;
+	if (js["time_integrator"] == "RKF45" || js["time_integrator"] == "IMPLICIT") {
+		if (js["isReduced"]) {
+			time_integrator = js["time_integrator"] == "RKF45" ? RKF45 : IMPLICIT;
+		}
+		else {
+			cout << js["time_integrator"] << " needs reduced coordinates, using the symplectic integrator" << endl;
+		}
+	}
+
+	// Looked up once, indexing js allocates
+	isReduced = js["isReduced"];
+	isPlotEnergy = js["isPlotEnergy"];
+	plot_steps = js["plot_steps"];
+	if (isPlotEnergy) {
+		Kvec.reserve(plot_steps);
+		Vvec.reserve(plot_steps);
+		Tvec.reserve(plot_steps);
+	}
 
 	// Init boxes	
 	auto box0 = addBox(js["Rz"], js["p0"], js["dimension"], js["scale"], js["mass"], boxShape, js["isReduced"], 0);	// No parent
@@ -88,12 +126,53 @@ void Scene::load(const string &RESOURCE_DIR)
 	box2->setCylinderStatus(js["isCylinder"]);
 	box2->setDoubleCylinderStatus(js["isDoubleCylinder"]);
 	box2->setSphereStatus(js["isSphere"]);
+	sphere_batch = make_shared<WrapBatch>();
+	cylinder_batch = make_shared<WrapBatch>();
+
+	// Wrap tables written by the batch tool, see tabulateWraps()
+	string wrap_table = js["wrap_table"];
+	if (!wrap_table.empty()) {
+		json tables;
+		ifstream i(RESOURCE_DIR + wrap_table);
+		i >> tables;
+		i.close();
+		loadWrapTables(tables);
+	}
 
 	if (time_integrator == SYMPLECTIC) {
 		symplectic_solver = make_shared<SymplecticIntegrator>(boxes, joints, springs, js["isReduced"], js["num_samples_on_muscle"], js["grav"], js["epsilon"]);
+		symplectic_solver->setArticulated(js["isArticulated"]);
+		symplectic_solver->setJointLimit(js["isJointLimit"]);
+		symplectic_solver->setStabilization(js["isStabilized"]);
+		symplectic_solver->setFactorizationTolerance(js["factorization_tol"]);
 	}
 	else if (time_integrator == RKF45) {
-		rkf45_solver = make_shared<RKF45Integrator>(boxes, springs, js["isReduced"]);
+		rkf45_solver = make_shared<RKF45Integrator>(boxes, joints, springs, js["isReduced"]);
+		rkf45_solver->setTolerance(js["rkf45_abserr"], js["rkf45_relerr"]);
+		rkf45_solver->setJointLimit(js["isJointLimit"]);
+	}
+	else if (time_integrator == IMPLICIT) {
+		implicit_solver = make_shared<ImplicitIntegrator>(boxes, joints, springs, js["isReduced"]);
+		implicit_solver->setFactorizationTolerance(js["factorization_tol"]);
+		implicit_solver->setJointLimit(js["isJointLimit"]);
+	}
+
+	if (js["isAdaptive"]) {
+		if (time_integrator == RKF45) {
+			cout << "RKF45 controls its own steps, isAdaptive is ignored" << endl;
+		}
+		else {
+			controller = make_shared<StepController>(h, js["h_min"], js["h_max"], js["adaptive_tol"]);
+		}
+	}
+
+	// Only the symplectic integrator without the articulated solve reads the sample inertia
+	bool isSampleInertia = !js["isMomentInertia"] && js["isReduced"] && time_integrator == SYMPLECTIC && !js["isArticulated"];
+	if (js["spring_refresh_tol"] > 0.0 && !isSampleInertia) {
+		cout << "spring_refresh_tol only applies to the sample inertia of the reduced, non-articulated symplectic step, it is ignored" << endl;
+	}
+	if (js["spring_cache_tol"] > 0.0 && !isSampleInertia) {
+		cout << "spring_cache_tol only applies to the sample inertia of the reduced, non-articulated symplectic step, it is ignored" << endl;
 	}
 
 	for (int i = 0; i < (int)springs.size(); ++i) {
@@ -159,6 +238,12 @@ shared_ptr<Spring> Scene::addSpring(json jp_x, shared_ptr<Rigid> p_parent, json
 	// Init Spring
 	double spring_mass = jmass;
 	auto spring = make_shared<Spring>(p, s, spring_mass, js["num_samples_on_muscle"], grav, js["epsilon"], js["isReduced"], js["stiffness"]);
+	spring->setAnalyticJacobian(js["isAnalyticJacobian"]);
+	spring->setCheckJacobian(js["isCheckJacobian"]);
+	spring->setMomentInertia(js["isMomentInertia"]);
+	spring->setElastic(js["isElastic"]);
+	spring->setRefreshTolerance(js["spring_refresh_tol"]);
+	spring->setCacheTolerance(js["spring_cache_tol"]);
 	if (js["isSpring"]) {	
 		springs.push_back(spring);		
 	}
@@ -169,12 +254,14 @@ shared_ptr<WrapSphere> Scene::addSphere(json jp_x, shared_ptr<Rigid> p_parent, j
 	auto ws_p = make_shared<Particle>(sphereShape);
 	from_json(jp_x, ws_p->x0);
 	ws_p->r = js["particle_r"];
+	ws_p->setParent(p_parent);
 	ws_p->update(p_parent->getE());
 	p_parent->addPoint(ws_p);
 
 	auto ws_s = make_shared<Particle>(sphereShape);
 	from_json(js_x, ws_s->x0);
 	ws_s->r = js["particle_r"];
+	ws_s->setParent(s_parent);
 	ws_s->update(s_parent->getE());
 	s_parent->addPoint(ws_s);
 
@@ -185,6 +272,7 @@ shared_ptr<WrapSphere> Scene::addSphere(json jp_x, shared_ptr<Rigid> p_parent, j
 	ws_o->x0 = Vector3d(s_radius + 0.5 * o_parent->getDimension()(0), -0.5 * o_parent->getDimension()(1) + 1.0, 0.0);
 	ws_o->x0 += o_x;
 	ws_o->r = s_radius;
+	ws_o->setParent(o_parent);
 	ws_o->update(o_parent->getE());
 	o_parent->addPoint(ws_o);
 
@@ -194,6 +282,9 @@ shared_ptr<WrapSphere> Scene::addSphere(json jp_x, shared_ptr<Rigid> p_parent, j
 	wrap_sphere->setP(ws_p);
 	wrap_sphere->setS(ws_s);
 	wrap_sphere->setO(ws_o);
+	wrap_sphere->setDerivatives(js["isWrapDerivatives"]);
+	wrap_sphere->setCheckDerivatives(js["isCheckWrapDerivatives"]);
+	wrap_sphere->setBatched(js["isWrapBatch"]);
 
 	wrap_sphere->setParent(s_parent);
 	s_parent->addSphere(wrap_sphere);
@@ -247,6 +338,9 @@ shared_ptr<WrapCylinder> Scene::addWrapCylinder(json jp_x, shared_ptr<Rigid> p_p
 	wrap_cylinder->setS(wc_s);
 	wrap_cylinder->setO(wc_o);
 	wrap_cylinder->setZ(wc_z);
+	wrap_cylinder->setDerivatives(js["isWrapDerivatives"]);
+	wrap_cylinder->setCheckDerivatives(js["isCheckWrapDerivatives"]);
+	wrap_cylinder->setBatched(js["isWrapBatch"]);
 
 	o_parent->addCylinder(wrap_cylinder);
 
@@ -278,6 +372,7 @@ shared_ptr<WrapDoubleCylinder> Scene::addWrapDoubleCylinder(json jp_x, shared_pt
 	wdc_u->x0 << u_radius + 0.5 * u_parent->getDimension()(0), -0.5 * u_parent->getDimension()(1) + 1.0, 0.0;
 	wdc_u->x0 += u_x;
 	wdc_u->r = js["particle_r"];
+	wdc_u->setParent(u_parent);
 	wdc_u->update(u_parent->getE());
 	u_parent->addPoint(wdc_u);
 
@@ -287,6 +382,7 @@ shared_ptr<WrapDoubleCylinder> Scene::addWrapDoubleCylinder(json jp_x, shared_pt
 	wdc_v->x0 << v_radius + 0.5 * v_parent->getDimension()(0), -0.5 * v_parent->getDimension()(1) + 1.0, 0.0;
 	wdc_v->x0 += v_x;
 	wdc_v->r = js["particle_r"];
+	wdc_v->setParent(v_parent);
 	wdc_v->update(v_parent->getE());
 	v_parent->addPoint(wdc_v);
 
@@ -321,6 +417,11 @@ shared_ptr<WrapDoubleCylinder> Scene::addWrapDoubleCylinder(json jp_x, shared_pt
 	wrap_doublecylinder->setV(wdc_v);
 	wrap_doublecylinder->setZ_U(wdc_z_u);
 	wrap_doublecylinder->setZ_V(wdc_z_v);
+	wrap_doublecylinder->setTolerance(js["wrap_tol"]);
+	wrap_doublecylinder->setMaxIterations(js["wrap_max_iters"]);
+	wrap_doublecylinder->setWarmStart(js["isWrapWarmStart"]);
+	wrap_doublecylinder->setDerivatives(js["isWrapDerivatives"]);
+	wrap_doublecylinder->setCheckDerivatives(js["isCheckWrapDerivatives"]);
 	wrap_doublecylinder->setE_U(u_parent->getE() * Ewrapu);
 	wrap_doublecylinder->setE_P_U(Ewrapu);
 	wrap_doublecylinder->setE_V(v_parent->getE() * Ewrapv);
@@ -361,33 +462,291 @@ void Scene::step()
 	if (step_i == 1) {
 		cout << "start" << endl;
 	}
+	AllocationCounter::reset();
+	if (controller) {
+		t += stepAdaptive();
+	}
+	else {
+		advance(h);
+		t += h;
+	}
+	// The wraps do not feed back into the dynamics, so only the poses the step ends on are solved
+	stepWraps();
+	step_i += 1;
+	computeEnergy();
+
+	if (isPlotEnergy) {
+		saveData(plot_steps);
+	}
+
+	// The workspaces are sized on the first steps, after that a step should not allocate.
+	// The implicit integrator still does, inside SelfAdjointEigenSolver.
+	step_allocs = AllocationCounter::getCount();
+	if (AllocationCounter::isEnabled() && step_i > 2 && step_allocs > 0) {
+		cout << "step " << step_i << " allocated " << AllocationCounter::getBytes() << " bytes in " << AllocationCounter::getCount() << " calls" << endl;
+	}
+}
+
+void Scene::advance(double dt)
+{
 	if (time_integrator == SYMPLECTIC) {
-		symplectic_solver->step(h);
-		for (int i = 0; i < (int)boxes.size(); ++i) {
-			boxes[i]->step(h);			
-			if (i != 0) {
-				//this->phi.segment<6>(6 * (i - 1)) = boxes[i]->getTwist();
+		symplectic_solver->step(dt);
+	}
+	else if (time_integrator == RKF45) {
+		rkf45_solver->step(dt);
+	}
+	else if (time_integrator == IMPLICIT) {
+		implicit_solver->step(dt);
+	}
+
+	// The solvers update the joints and twists, the poses follow from them
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		boxes[i]->step(dt);
+	}
+	if (time_integrator == SYMPLECTIC) {
+		drift = symplectic_solver->stabilize();
+	}
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		springs[i]->step(joints);
+	}
+}
+
+double Scene::stepAdaptive()
+{
+	// Step doubling: one step of dt against two of dt / 2, the two half steps are kept
+	saveState(state0);
+	for (;;) {
+		double dt = controller->getStepSize(joints);
+		advance(dt);
+		saveState(state_full);
+		restoreState(state0);
+		advance(0.5 * dt);
+		advance(0.5 * dt);
+
+		double err = 0.0;
+		if (isReduced) {
+			for (int i = 0; i < (int)joints.size(); ++i) {
+				err = max(err, abs(joints[i]->getTheta() - state_full.thetalist(i)));
+			}
+		}
+		else {
+			for (int i = 1; i < (int)boxes.size(); ++i) {
+				err = max(err, SE3::log(SE3::inverse(state_full.E[i]) * boxes[i]->getE()).norm());
 			}
 		}
-		//MatrixXd jj = symplectic_solver->getJ_twist_thetadot();
-		for (int i = 0; i < (int)springs.size(); ++i) {
-			springs[i]->step(joints);
+
+		if (controller->update(dt, err)) {
+			return dt;
 		}
+		restoreState(state0);
 	}
-	else if (time_integrator == RKF45) {
-		// nothing
+}
 
-	}else{
-		// nothing
+// Gathers the obstacles of one type that are waiting for the batch into its columns, solves
+// them and hands each its results. The batch keeps its size from step to step.
+template <typename Wrap>
+static void stepWrapBatch(const vector<shared_ptr<Wrap>> &obsts, WrapBatch &batch, void (WrapBatch::*compute)())
+{
+	int n = 0;
+	for (int i = 0; i < (int)obsts.size(); ++i) {
+		n += obsts[i]->getBatchPending();
 	}
-	//cout << "t   " << t << endl;
-	t += h;
-	step_i += 1;
-	computeEnergy();
+	if (n == 0) {
+		return;
+	}
+	batch.resize(n);
+	for (int i = 0, j = 0; i < (int)obsts.size(); ++i) {
+		if (obsts[i]->getBatchPending()) {
+			obsts[i]->getBatchInputs(batch, j++);
+		}
+	}
+	(batch.*compute)();
+	for (int i = 0, j = 0; i < (int)obsts.size(); ++i) {
+		if (obsts[i]->getBatchPending()) {
+			obsts[i]->setBatchResults(batch, j++);
+		}
+	}
+}
 
-	if (js["isPlotEnergy"]) {
-		int plot_steps = js["plot_steps"];
-		saveData(plot_steps);
+void Scene::stepWraps()
+{
+	stepWrapBatch(wrap_spheres, *sphere_batch, &WrapBatch::computeSpheres);
+	stepWrapBatch(wrap_cylinders, *cylinder_batch, &WrapBatch::computeCylinders);
+}
+
+void Scene::saveState(State &state) const
+{
+	Joint::getThetaVector(joints, state.thetalist);
+	Joint::getThetadotVector(joints, state.thetadotlist);
+	state.E.resize(boxes.size());
+	state.twists.resize(boxes.size());
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		state.E[i] = boxes[i]->getE();
+		state.twists[i] = boxes[i]->getTwist();
+	}
+	state.spring_counters.resize(springs.size());
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		state.spring_counters[i] = springs[i]->getCounters();
+	}
+}
+
+void Scene::restoreState(const State &state)
+{
+	for (int i = 0; i < (int)joints.size(); ++i) {
+		joints[i]->setTheta(state.thetalist(i));
+		joints[i]->setThetadot(state.thetadotlist(i));
+	}
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		boxes[i]->setE(state.E[i]);
+		boxes[i]->setTwist(state.twists[i]);
+	}
+
+	// The caches were advanced by the discarded steps. They are cheaper to rebuild than to
+	// save, and the factorization and the warm start only affect the cost, not the result.
+	if (symplectic_solver && symplectic_solver->getFactorization()) {
+		symplectic_solver->getFactorization()->invalidate();
+	}
+	if (implicit_solver) {
+		implicit_solver->getFactorization()->invalidate();
+	}
+	for (int i = 0; i < (int)wrap_doublecylinders.size(); ++i) {
+		wrap_doublecylinders[i]->resetWarmStart();
+	}
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		springs[i]->invalidate();
+	}
+
+	// Rebuild everything that depends on the poses, a zero step does not move the boxes
+	for (int i = 0; i < (int)boxes.size(); ++i) {
+		boxes[i]->step(0.0);
+	}
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		springs[i]->step(joints);
+		springs[i]->setCounters(state.spring_counters[i]);
+	}
+}
+
+// Wrap margins of the table channels, one per surface the path can wrap
+static int getNumWrapMargins(const WrapObst &) { return 1; }
+static int getNumWrapMargins(const WrapDoubleCylinder &) { return 2; }
+static void getWrapMargins(const WrapObst &obst, VectorXd &values)
+{
+	values(1) = obst.getWrapMargin();
+}
+static void getWrapMargins(const WrapDoubleCylinder &obst, VectorXd &values)
+{
+	values(1) = obst.get_margin_u();
+	values(2) = obst.get_margin_v();
+}
+
+// One wrap obstacle over the range of the joints it depends on, given per scene joint. The
+// length is the full path from P to S and the moment arms come from the analytic derivatives
+// of the solve.
+template <typename Wrap>
+static json tabulateWrap(const shared_ptr<Wrap> &obst, const vector<shared_ptr<Rigid>> &boxes, const vector<shared_ptr<Joint>> &joints,
+	MLBasisFunction::MLBasisFunctionType type, int num_knots, const VectorXd &joint_min, const VectorXd &joint_max, VectorXd &err)
+{
+	vector<int> ids = obst->getJointIds();
+	int d = (int)ids.size();
+	VectorXd theta_min(d), theta_max(d);
+	for (int i = 0; i < d; ++i) {
+		theta_min(i) = joint_min(ids[i]);
+		theta_max(i) = joint_max(ids[i]);
+	}
+
+	// The samples need the derivatives right away, so the obstacle solves on its own
+	obst->setTable(nullptr);
+	bool isBatched = obst->getBatched();
+	obst->setBatched(false);
+	int nm = getNumWrapMargins(*obst);
+	WrapTable table;
+	err = table.fit(type, ids, theta_min, theta_max, num_knots, nm, [&](const VectorXd &theta, VectorXd &values) {
+		for (int i = 0; i < d; ++i) {
+			joints[ids[i]]->setTheta(theta(i));
+		}
+		for (int i = 0; i < (int)boxes.size(); ++i) {
+			boxes[i]->step(0.0);
+		}
+		obst->step();
+		obst->computeDerivatives();
+		VectorXd arms = obst->computeMomentArms((int)joints.size());
+		values(0) = obst->getTotalLength();
+		getWrapMargins(*obst, values);
+		for (int i = 0; i < d; ++i) {
+			values(1 + nm + i) = arms(ids[i]);
+		}
+	});
+	obst->setBatched(isBatched);
+	return table.toJson();
+}
+
+json Scene::tabulateWraps(const string &basis, int num_knots, double tol, const VectorXd &theta_min, const VectorXd &theta_max)
+{
+	json tables = json::array();
+	if (!isReduced) {
+		cout << "Wrap tables need reduced coordinates" << endl;
+		return tables;
+	}
+	auto type = (basis == "cubic") ? MLBasisFunction::CUBIC_BSPLINE : MLBasisFunction::LINEAR_BSPLINE;
+
+	State state;
+	saveState(state);
+	VectorXd err;
+	auto add = [&](json table, const string &name, int index) {
+		// Every channel must match the solve to tol at the samples
+		int nm = table["num_margins"];
+		int na = (int)err.size() - 1 - nm;
+		cout << name << " " << index << " length error: " << err(0) << ", margin error: " << err.segment(1, nm).maxCoeff();
+		if (na > 0) {
+			cout << ", moment arm error: " << err.tail(na).maxCoeff();
+		}
+		cout << endl;
+		if (!(err.maxCoeff() <= tol)) {
+			cout << name << " " << index << " not saved, the fit error is over " << tol << endl;
+			return;
+		}
+		table["type"] = name;
+		table["index"] = index;
+		tables.push_back(table);
+	};
+	for (int i = 0; i < (int)wrap_spheres.size(); ++i) {
+		add(tabulateWrap(wrap_spheres[i], boxes, joints, type, num_knots, theta_min, theta_max, err), "sphere", i);
+	}
+	for (int i = 0; i < (int)wrap_cylinders.size(); ++i) {
+		add(tabulateWrap(wrap_cylinders[i], boxes, joints, type, num_knots, theta_min, theta_max, err), "cylinder", i);
+	}
+	for (int i = 0; i < (int)wrap_doublecylinders.size(); ++i) {
+		add(tabulateWrap(wrap_doublecylinders[i], boxes, joints, type, num_knots, theta_min, theta_max, err), "double_cylinder", i);
+	}
+	restoreState(state);
+	stepWraps();
+	return tables;
+}
+
+void Scene::loadWrapTables(const json &tables)
+{
+	for (const auto &j : tables) {
+		string type = j["type"];
+		int index = j["index"];
+		if (!j.count("num_margins")) {
+			cout << "The " << type << " " << index << " wrap table has no wrap margins, tabulate it again" << endl;
+			continue;
+		}
+		auto table = make_shared<WrapTable>();
+		table->fromJson(j);
+		table->setJoints(joints);
+		if (type == "sphere" && index < (int)wrap_spheres.size()) {
+			wrap_spheres[index]->setTable(table);
+		}
+		else if (type == "cylinder" && index < (int)wrap_cylinders.size()) {
+			wrap_cylinders[index]->setTable(table);
+		}
+		else if (type == "double_cylinder" && index < (int)wrap_doublecylinders.size()) {
+			wrap_doublecylinders[index]->setTable(table);
+		}
+		else {
+			cout << "No " << type << " " << index << " for the wrap table" << endl;
+		}
 	}
 }
 
@@ -414,7 +773,6 @@ void Scene::saveData(int num_steps) {
 			Vv(i) = Vvec[i];
 			Tv(i) = Tvec[i];
 		}
-		bool isReduced = js["isReduced"];
 		if (isReduced) {
 			vec_to_file(Kv, "Kr");
 			vec_to_file(Vv, "Vr");
@@ -446,20 +804,6 @@ void Scene::computeEnergy() {
 		//cout <<" i " << i<<endl<< vi << endl;
 		//cout << " i " << i<<endl << ki << endl;
 	}	
-	VectorXd angles = Joint::getThetaVector(joints);
-	//cout <<"angles"<< angles << endl;
-
-	//cout << sin(90) << endl;
-	//angles *= 1.0 / 2.0 / 3.1415926 * 360;
-	double h1 = 2.0 * sin(angles(0));
-	double h2 = 2 * h1 + 2 * sin(angles(0) + angles(1));
-	double v1 = - 4.2 * 9.81 * h1;
-	double v2 = - 4.2 * 9.81 * h2;
-
-	//cout << "h1 " << h1 << endl;
-	//cout << "h2 " << h2 << endl;
-	//cout << "v1 + v2" << v1 + v2 << endl;
-	
 
 	// Spring:
 	for (int i = 0; i < (int)springs.size(); ++i) {
@@ -483,5 +827,7 @@ void Scene::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, con
 		springs[i]->draw(MV, prog, prog2, P);
 	}
 
-	symplectic_solver->draw(MV, prog2, P);
+	if (time_integrator == SYMPLECTIC) {
+		symplectic_solver->draw(MV, prog2, P);
+	}
 }
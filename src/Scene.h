@@ -10,6 +10,7 @@
 #include <Eigen/Dense>
 #include <json.hpp>
 #include "MLCommon.h"
+#include "Spring.h"
 
 class Particle;
 class MatrixStack;
@@ -17,14 +18,16 @@ class Program;
 class Shape;
 class Rigid;
 class Solver;
-class Spring;
 class Joint;
 class Vector;
 class WrapSphere;
 class WrapCylinder;
 class WrapDoubleCylinder;
+class WrapBatch;
 class SymplecticIntegrator;
 class RKF45Integrator;
+class ImplicitIntegrator;
+class StepController;
 
 class Scene
 {
@@ -33,7 +36,8 @@ public:
 	Scene();
 	virtual ~Scene();
 	
-	void load(const std::string &RESOURCE_DIR);
+	void load(const std::string &RESOURCE_DIR, const std::string &JSON_FILE = "input.json");
+	void loadFromJson(const std::string &RESOURCE_DIR, const nlohmann::json &_js);
 	void init();
 	void tare();
 	void reset();
@@ -46,13 +50,51 @@ public:
 	std::shared_ptr<WrapCylinder> addWrapCylinder(nlohmann::json jp_x, std::shared_ptr<Rigid> p_parent, nlohmann::json js_x, std::shared_ptr<Rigid> s_parent, nlohmann::json jo_x, std::shared_ptr<Rigid> o_parent, nlohmann::json jradius, nlohmann::json jzdir);
 	std::shared_ptr<WrapDoubleCylinder> addWrapDoubleCylinder(nlohmann::json jp_x, std::shared_ptr<Rigid> p_parent, nlohmann::json js_x, std::shared_ptr<Rigid> s_parent, nlohmann::json ju_x, std::shared_ptr<Rigid> u_parent, nlohmann::json jv_x, std::shared_ptr<Rigid> v_parent, nlohmann::json juradius, nlohmann::json jvradius, nlohmann::json jzudir, nlohmann::json jzvdir);
 	
+	// Fit a WrapTable to every wrap obstacle over [theta_min, theta_max], one entry per joint,
+	// reduced coord only. basis is "linear" or "cubic". A table whose length or moment arms
+	// miss the solve by more than tol at the samples is left out. Outside its range an
+	// obstacle solves. The scene is left as it was.
+	nlohmann::json tabulateWraps(const std::string &basis, int num_knots, double tol,
+		const Eigen::VectorXd &theta_min, const Eigen::VectorXd &theta_max);
+	// Serve the wrap obstacles from tables written by tabulateWraps()
+	void loadWrapTables(const nlohmann::json &tables);
+
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
 	void computeEnergy();
 	void saveData(int num_steps);
 	double getTime() const { return t; }
+	double getDrift() const { return drift; }
+	size_t getStepAllocations() const { return step_allocs; }
+	double getKineticEnergy() const { return K; }
+	double getPotentialEnergy() const { return V; }
+	const std::vector< std::shared_ptr<Rigid> > &getBoxes() const { return boxes; }
+	const std::vector< std::shared_ptr<Joint> > &getJoints() const { return joints; }
+	const std::vector< std::shared_ptr<Spring> > &getSprings() const { return springs; }
+	const std::vector< std::shared_ptr<WrapSphere> > &getWrapSpheres() const { return wrap_spheres; }
+	const std::vector< std::shared_ptr<WrapCylinder> > &getWrapCylinders() const { return wrap_cylinders; }
+	const std::vector< std::shared_ptr<WrapDoubleCylinder> > &getWrapDoubleCylinders() const { return wrap_doublecylinders; }
+	std::shared_ptr<StepController> getStepController() const { return controller; }
 
 private:
+	// What the integrators read at the start of a step, the rest follows from it
+	struct State {
+		Eigen::VectorXd thetalist;
+		Eigen::VectorXd thetadotlist;
+		std::vector<Eigen::Matrix4d> E;
+		std::vector<Vector6d> twists;
+		std::vector<Spring::Counters> spring_counters;
+	};
+
+	void advance(double dt);
+	double stepAdaptive();
+	// Solves the spheres and the cylinders whose last step() left compute() to the batches
+	void stepWraps();
+	void saveState(State &state) const;
+	void restoreState(const State &state);
+
 	double t;
+	double drift;	// largest joint drift of the last step, before stabilization (maximal coord)
+	size_t step_allocs;	// heap allocations of the last step, with ML_COUNT_ALLOCATIONS
 	double h;
 	int step_i;
 	Eigen::Vector3d grav;
@@ -88,11 +130,20 @@ private:
 	std::vector< std::shared_ptr<WrapCylinder> > wrap_cylinders;
 	std::vector< std::shared_ptr<WrapDoubleCylinder> > wrap_doublecylinders;
 	std::vector< std::shared_ptr<WrapSphere> > wrap_spheres;
+	std::shared_ptr<WrapBatch> sphere_batch;	// one column per sphere solved in the step
+	std::shared_ptr<WrapBatch> cylinder_batch;
 
 	std::shared_ptr<SymplecticIntegrator> symplectic_solver;
 	std::shared_ptr<RKF45Integrator> rkf45_solver;
+	std::shared_ptr<ImplicitIntegrator> implicit_solver;
+	std::shared_ptr<StepController> controller;	// null for fixed steps
+	State state0;		// start of the adaptive step
+	State state_full;	// after the full step
 	nlohmann::json js;
 	Integrator time_integrator;
+	bool isReduced;
+	bool isPlotEnergy;
+	int plot_steps;
 };
 
 #endif // MUSCLEMASS_SRC_SCENE_H_
\ No newline at end of file
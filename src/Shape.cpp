@@ -1,8 +1,10 @@
 #include "Shape.h"
 #include <iostream>
 
+#ifndef ML_HEADLESS
 #include "GLSL.h"
 #include "Program.h"
+#endif
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
@@ -68,6 +70,7 @@ void Shape::loadMesh(const string &meshName)
 
 void Shape::init()
 {
+#ifndef ML_HEADLESS
 	// Send the position array to the GPU
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
@@ -91,10 +94,12 @@ void Shape::init()
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	
 	GLSL::checkError(GET_FILE_LINE);
+#endif
 }
 
 void Shape::draw(const shared_ptr<Program> prog) const
 {
+#ifndef ML_HEADLESS
 	GLSL::checkError(GET_FILE_LINE);
 	// Bind position buffer
 	int h_pos = prog->getAttribute("aPos");
@@ -133,4 +138,5 @@ void Shape::draw(const shared_ptr<Program> prog) const
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	
 	GLSL::checkError(GET_FILE_LINE);
+#endif
 }
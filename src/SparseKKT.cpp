@@ -0,0 +1,208 @@
+#include "SparseKKT.h"
+
+#include "Rigid.h"
+#include "Joint.h"
+#include "Spring.h"
+
+#include <iostream>
+#include <cassert>
+
+using namespace std;
+using namespace Eigen;
+
+SparseKKT::SparseKKT(vector< shared_ptr<Rigid> > _boxes, vector< shared_ptr<Spring> > _springs) :
+	boxes(_boxes),
+	springs(_springs),
+	rho(0.0),
+	isPatternReady(false),
+	isAnalyzed(false)
+{
+	int nboxes = (int)boxes.size();
+	nb = 6 * nboxes;
+	n = nb + 6 + 5 * (nboxes - 1);
+	A.resize(n, n);
+	b_perm.resize(n);
+	x_perm.resize(n);
+
+	int nj = nboxes - 1;
+	parent_id.resize(nj);
+	child_id.resize(nj);
+	G_P.resize(nj);
+	G_C.resize(nj);
+	for (int i = 1, j = 0; i < nboxes; ++i, ++j) {
+		parent_id[j] = boxes[i]->getParent()->getIndex();
+		child_id[j] = boxes[i]->getIndex();
+	}
+
+	for (int i = 0; i < nboxes; ++i) {
+		rho = max(rho, boxes[i]->getMassMatrix().diagonal().maxCoeff());
+	}
+
+	// Elimination order: each box, then the rows of the joints whose boxes are both placed.
+	// The fixed box is followed by its own 6 rows.
+	order.assign(n, -1);
+	vector<bool> isPlaced(nboxes, false);
+	vector<bool> isJointPlaced(nj, false);
+	int k = 0;
+	for (int i = 0; i < nboxes; ++i) {
+		for (int r = 0; r < 6; ++r) {
+			order[6 * i + r] = k++;
+		}
+		isPlaced[i] = true;
+		if (i == 0) {
+			for (int r = 0; r < 6; ++r) {
+				order[nb + r] = k++;
+			}
+		}
+		for (int j = 0; j < nj; ++j) {
+			if (!isJointPlaced[j] && isPlaced[parent_id[j]] && isPlaced[child_id[j]]) {
+				for (int r = 0; r < 5; ++r) {
+					order[nb + 6 + 5 * j + r] = k++;
+				}
+				isJointPlaced[j] = true;
+			}
+		}
+	}
+	assert(k == n);
+}
+
+void SparseKKT::addCoeff(int row, int col, double value) {
+	row = order[row];
+	col = order[col];
+	if (isPatternReady) {
+		A.coeffRef(row, col) += value;
+	}
+	else {
+		// Keep explicit zeros so the pattern does not depend on the values
+		triplets.push_back(Triplet<double>(row, col, value));
+	}
+}
+
+void SparseKKT::addBlock(int row, int col, const Ref<const MatrixXd> &block) {
+	for (int j = 0; j < block.cols(); ++j) {
+		for (int i = 0; i < block.rows(); ++i) {
+			addCoeff(row + i, col + j, block(i, j));
+		}
+	}
+}
+
+void SparseKKT::addBlockSym(int row, int col, const Ref<const MatrixXd> &block) {
+	// The transpose is written coefficient by coefficient, binding block.transpose()
+	// to a Ref would copy it to the heap
+	for (int j = 0; j < block.cols(); ++j) {
+		for (int i = 0; i < block.rows(); ++i) {
+			addCoeff(row + i, col + j, block(i, j));
+			addCoeff(col + j, row + i, block(i, j));
+		}
+	}
+}
+
+void SparseKKT::assemble(const vector<Matrix12d> &M_springs) {
+	if (isPatternReady) {
+		A.coeffs().setZero();
+	}
+	else {
+		triplets.clear();
+	}
+
+	int nboxes = (int)boxes.size();
+	for (int i = 0; i < nboxes; i++) {
+		addBlock(6 * i, 6 * i, boxes[i]->getMassMatrix());
+	}
+
+	// The fixed box, its rows are the identity so the augmented term is rho I
+	Matrix6d I6 = Matrix6d::Identity();
+	addBlockSym(nb, 0, I6);
+	Matrix6d rho_I6 = rho * I6;
+	addBlock(0, 0, rho_I6);
+
+	for (int j = 0; j < (int)parent_id.size(); ++j) {
+		auto joint = boxes[child_id[j]]->getJoint();
+		Matrix6d Ad_J_P = Rigid::adjoint(joint->getE_P_J().inverse());
+		Matrix6d Ad_J_C = -Rigid::adjoint(joint->getE_C_J().inverse());
+
+		G_P[j].block<2, 6>(0, 0) = Ad_J_P.block<2, 6>(0, 0);
+		G_P[j].block<3, 6>(2, 0) = Ad_J_P.block<3, 6>(3, 0);
+		G_C[j].block<2, 6>(0, 0) = Ad_J_C.block<2, 6>(0, 0);
+		G_C[j].block<3, 6>(2, 0) = Ad_J_C.block<3, 6>(3, 0);
+
+		int row = nb + 6 + 5 * j;
+		int ip = 6 * parent_id[j];
+		int ic = 6 * child_id[j];
+		addBlockSym(row, ip, G_P[j]);
+		addBlockSym(row, ic, G_C[j]);
+
+		// rho G^T G couples the parent and the child
+		Matrix6d GG;
+		GG.noalias() = rho * G_P[j].transpose() * G_P[j];
+		addBlock(ip, ip, GG);
+		GG.noalias() = rho * G_P[j].transpose() * G_C[j];
+		addBlockSym(ip, ic, GG);
+		GG.noalias() = rho * G_C[j].transpose() * G_C[j];
+		addBlock(ic, ic, GG);
+	}
+
+	// Spring inertia couples the boxes it is attached to, each spring adds its four blocks
+	// directly. Springs on the same boxes hit the same entries, so the pattern is unchanged.
+	for (int k = 0; k < (int)M_springs.size(); ++k) {
+		Vector2d box_id = springs[k]->getBoxID();
+		for (int a = 0; a < 2; ++a) {
+			for (int b = 0; b < 2; ++b) {
+				addBlock(6 * (int)box_id(a), 6 * (int)box_id(b), M_springs[k].block<6, 6>(6 * a, 6 * b));
+			}
+		}
+	}
+
+	// Keep the zero diagonal of the constraint block in the pattern
+	for (int i = nb; i < n; ++i) {
+		addCoeff(i, i, 0.0);
+	}
+
+	if (!isPatternReady) {
+		A.setFromTriplets(triplets.begin(), triplets.end());
+		A.makeCompressed();
+		triplets.clear();
+		triplets.shrink_to_fit();
+		isPatternReady = true;
+	}
+}
+
+void SparseKKT::solve(const VectorXd &b, VectorXd &x) {
+	if (!isAnalyzed) {
+		ldlt.analyzePattern(A);
+		isAnalyzed = true;
+	}
+	ldlt.factorize(A);
+	if (ldlt.info() != Success) {
+		cout << "SparseKKT: factorization failed" << endl;
+	}
+	resolve(b, x);
+}
+
+void SparseKKT::resolve(const VectorXd &b, VectorXd &x) {
+	assert(isAnalyzed);
+	// Permute b + rho G^T c into the elimination order
+	for (int i = 0; i < n; ++i) {
+		b_perm(order[i]) = b(i);
+	}
+	for (int r = 0; r < 6; ++r) {
+		b_perm(order[r]) += rho * b(nb + r);
+	}
+	for (int j = 0; j < (int)parent_id.size(); ++j) {
+		int row = nb + 6 + 5 * j;
+		for (int r = 0; r < 6; ++r) {
+			b_perm(order[6 * parent_id[j] + r]) += rho * G_P[j].col(r).dot(b.segment<5>(row));
+			b_perm(order[6 * child_id[j] + r]) += rho * G_C[j].col(r).dot(b.segment<5>(row));
+		}
+	}
+	x_perm = ldlt.solve(b_perm);
+	x.resize(n);
+	for (int i = 0; i < n; ++i) {
+		x(i) = x_perm(order[i]);
+	}
+}
+
+SparseKKT::~SparseKKT()
+{
+
+}
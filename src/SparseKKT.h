@@ -0,0 +1,74 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_SPARSEKKT_H_
+#define MUSCLEMASS_SRC_SPARSEKKT_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "MLCommon.h"
+
+class Rigid;
+class Spring;
+
+// Sparse LDL^T of a matrix that is already in elimination order. SimplicialLDLT's own
+// factorize() and solve() permute through temporaries, which allocates every step.
+class PreorderedLDLT : public Eigen::SimplicialLDLT< Eigen::SparseMatrix<double>, Eigen::Upper, Eigen::NaturalOrdering<int> >
+{
+public:
+	void analyzePattern(const Eigen::SparseMatrix<double> &A) { analyzePattern_preordered(A, true); }
+	void factorize(const Eigen::SparseMatrix<double> &A) { factorize_preordered<true>(A); }
+};
+
+// KKT matrix of the maximal coordinate system
+//     [ M  G^T ] [ phi    ]   [ b ]
+//     [ G   0  ] [ lambda ] = [ c ]
+// M holds the box and spring inertia, G the fixed box and the 5 rows of each joint.
+// M is singular (thin boxes have no inertia about their long axis), so the system that is
+// factored is the augmented one, with M + rho G^T G in place of M and b + rho G^T c in place
+// of b. It has the same solution, and its body block is positive definite, so an LDL^T
+// without pivoting goes through when each joint's rows are eliminated right after its child.
+// That order only depends on the topology and keeps a chain banded, so the symbolic analysis
+// is done once and the steps after the first do not allocate.
+class SparseKKT
+{
+public:
+	SparseKKT(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Spring> > _springs);
+	virtual ~SparseKKT();
+
+	// M_springs holds the inertia of each spring over the twists of its two boxes, in spring order
+	void assemble(const std::vector<Matrix12d> &M_springs);
+	void solve(const Eigen::VectorXd &b, Eigen::VectorXd &x);
+	// Solves with the factorization of the last solve(), for a configuration that has barely moved
+	void resolve(const Eigen::VectorXd &b, Eigen::VectorXd &x);
+
+	int getSize() const { return this->n; }
+	int getNumBodyDofs() const { return this->nb; }
+
+private:
+	void addCoeff(int row, int col, double value);
+	void addBlock(int row, int col, const Eigen::Ref<const Eigen::MatrixXd> &block);
+	void addBlockSym(int row, int col, const Eigen::Ref<const Eigen::MatrixXd> &block);
+
+	std::vector< std::shared_ptr<Rigid> > boxes;
+	std::vector< std::shared_ptr<Spring> > springs;
+	int nb;	// 6 * number of boxes
+	int n;	// nb + 6 + 5 * number of joints
+	double rho;	// weight of the augmented term, of the order of the box inertia
+
+	std::vector<int> order;			// position of each row in the elimination order
+	std::vector<int> parent_id;		// parent box of each joint
+	std::vector<int> child_id;		// child box of each joint
+	std::vector<Matrix5x6d> G_P;	// constraint rows of each joint on its parent
+	std::vector<Matrix5x6d> G_C;	// and on its child
+	Eigen::SparseMatrix<double> A;	// augmented KKT matrix, in elimination order
+	PreorderedLDLT ldlt;
+	std::vector< Eigen::Triplet<double> > triplets;
+	Eigen::VectorXd b_perm;		// right-hand side in elimination order
+	Eigen::VectorXd x_perm;		// solution in elimination order
+	bool isPatternReady;	// A has its pattern, values are written in place
+	bool isAnalyzed;		// the symbolic factorization is done
+};
+
+#endif // MUSCLEMASS_SRC_SPARSEKKT_H_
@@ -1,9 +1,12 @@
 #include "Spring.h"
 
 #include <iostream>
+#include <algorithm>
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -12,16 +15,19 @@
 #include "Particle.h"
 #include "Joint.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Rigid.h"
-#include <unsupported/Eigen/MatrixFunctions> // TODO: avoid using this later, write a func instead
+#include "SE3.h"
 
 using namespace std;
 using namespace Eigen;
 
 Spring::Spring(shared_ptr<Particle> p0, shared_ptr<Particle> p1, double _mass, int num_samples, Vector3d _grav, double _epsilon, bool _isReduced, double _stiffness) :
-	E(_stiffness), mass(_mass), grav(_grav), epsilon(_epsilon), isReduced(_isReduced)
+	E(_stiffness), mass(_mass), grav(_grav), epsilon(_epsilon), isReduced(_isReduced), isAnalyticJacobian(false), isCheckJacobian(false), isMomentInertia(false), isElastic(false),
+	isSamplesCurrent(false), isStale(false), refresh_tol(0.0), cache_tol(0.0), num_refreshes(0), num_steps(0), num_hits(0), num_misses(0)
 {
 	assert(p0);
 	assert(p1);
@@ -39,46 +45,276 @@ Spring::Spring(shared_ptr<Particle> p0, shared_ptr<Particle> p1, double _mass, i
 	box_id(0) = p0->getParent()->getIndex();
 	box_id(1) = p1->getParent()->getIndex();
 
-	Matrix3x12d J;
-	J.setZero();
-	
-	double dm = this->mass / num_samples;
-
-	for (int i = 0; i < num_samples; ++i) {
-		auto sample = make_shared<Particle>();
-		double s = i / double(num_samples - 1);
-		//cout << s << endl;
-		sample->s = s;
-		sample->x = (1 - s)*p0->x + s*p1->x;
-		sample->m = dm;
-		if (!isReduced) {
-			sample->setJacobianMatrix(J);
-		}
-		samples.push_back(sample);
+	samples.init(this->mass, num_samples);
+	samples.updatePosition(p0->x, p1->x);
+	if (!isReduced) {
+		samples.resizeJacobian(12);
+	}
+
+	mu0 = 0.0;
+	mu1 = 0.0;
+	mu00 = 0.0;
+	mu01 = 0.0;
+	mu11 = 0.0;
+
+	for (int i = 0; i < samples.size(); ++i) {
+		double s = samples.s(i);
+		double dm = samples.m(i);
+		mu0 += dm * (1 - s);
+		mu1 += dm * s;
+		mu00 += dm * (1 - s) * (1 - s);
+		mu01 += dm * s * (1 - s);
+		mu11 += dm * s * s;
 	}
 }
 
-void Spring::step(vector<shared_ptr<Joint>> joints) {
+void Spring::step(const vector<shared_ptr<Joint>> &joints) {
 	computeLength();
-	updateSamplesPosition();
-	updateSamplesJacobian(joints);
+	num_steps++;
+	bool isCached = isInertiaCached();
+	if (isCached) {
+		Joint::getThetaVector(joints, thetalist);
+	}
+	if (isMomentInertia) {
+		// Only the endpoints are needed, the samples are left untouched
+		updateSamplesJacobianAnalytic(joints);
+	}
+	else if (needsRefresh()) {
+		updateSamplesPosition();
+		updateSamplesJacobian(joints);
+		if (isElastic && !isAnalyticJacobian) {
+			// The elastic force needs the endpoint Jacobians, the finite difference path skips them
+			computeEndpointJacobians(joints);
+		}
+		x0_refresh = p0->x;
+		x1_refresh = p1->x;
+		if (isReduced) {
+			int n = (int)joints.size();
+			M_samples.setZero(n, n);
+			f_samples.setZero(n);
+			samples.addMassMatrix(M_samples);
+			samples.addGravity(f_samples, grav);
+		}
+		isSamplesCurrent = true;
+		num_refreshes++;
+	}
+	else {
+		// Reduced only. The samples keep the inertia and gravity of the last refresh, both off
+		// by the same drift. The endpoints are cheap and stay current for the elastic force
+		// and the energy.
+		Joint::getThetadotVector(joints, thetadotlist);
+		computeEndpointJacobians(joints);
+		isSamplesCurrent = false;
+	}
+	if (isCached) {
+		updateInertiaCache(joints);
+	}
+	isStale = false;
 	computeEnergy();
 }
 
+Spring::Counters Spring::getCounters() const {
+	Counters counters;
+	counters.num_steps = num_steps;
+	counters.num_refreshes = num_refreshes;
+	counters.num_hits = num_hits;
+	counters.num_misses = num_misses;
+	return counters;
+}
+
+void Spring::setCounters(const Counters &counters) {
+	num_steps = counters.num_steps;
+	num_refreshes = counters.num_refreshes;
+	num_hits = counters.num_hits;
+	num_misses = counters.num_misses;
+}
+
+bool Spring::needsRefresh() const {
+	// The sample inertia is a smooth function of the endpoints, so their drift since the
+	// last refresh bounds its error. A zero tolerance refreshes every step. This only skips
+	// sample passes: the spring is still stepped with the rigid bodies, at the same h.
+	// With the inertia cache on, the samples are only needed when the cache is rebuilt.
+	if (isInertiaCached()) {
+		return isCacheMiss();
+	}
+	// The maximal coordinate inertia and gravity are summed over the samples directly, so
+	// they are refreshed every step.
+	if (!isReduced || refresh_tol <= 0.0 || num_refreshes == 0 || isStale) {
+		return true;
+	}
+	double drift = max((p0->x - x0_refresh).norm(), (p1->x - x1_refresh).norm());
+	return drift > refresh_tol * L;
+}
+
+bool Spring::isCacheMiss() const {
+	return isStale || num_misses == 0 || theta_cache.size() != thetalist.size() || (thetalist - theta_cache).lpNorm<Infinity>() > cache_tol;
+}
+
+void Spring::updateInertiaCache(const vector<shared_ptr<Joint>> &joints) {
+	// M_s and the gravity term are smooth in the joint angles. Near the point where they were
+	// last evaluated they are replaced by their first order Taylor expansion, which is exact
+	// up to O(|dtheta|^2) and costs one n x n update per joint instead of a pass over the samples.
+	if (isCacheMiss()) {
+		computeEndpointJacobians(joints);
+		theta_cache = thetalist;
+		// Refreshed in this step by needsRefresh()
+		M_cache = M_samples;
+		f_cache = f_samples;
+		computeInertiaGradients();
+		M_eval = M_cache;
+		f_eval = f_cache;
+		num_misses++;
+		return;
+	}
+
+	dtheta = thetalist;
+	dtheta -= theta_cache;
+	M_eval = M_cache;
+	for (int k = 0; k < dtheta.size(); ++k) {
+		if (dtheta(k) != 0.0) {
+			M_eval += dtheta(k) * dM[k];
+		}
+	}
+	f_eval = f_cache;
+	f_eval.noalias() += df * dtheta;
+	num_hits++;
+}
+
+void Spring::computeInertiaGradients() {
+	// Gradients of the moment inertia and gravity, which are exact for the straight spring.
+	// With J_i = (1 - s_i) J0 + s_i J1,
+	// dM / dq_k = P_k + P_k^T with P_k = dJ0^T (mu00 J0 + mu01 J1) + dJ1^T (mu01 J0 + mu11 J1),
+	// df / dq_k = dJ0^T mu0 g + dJ1^T mu1 g.
+	// Column j of J is w_j x (x - o_j), so with a the nearer to the root of j and k,
+	// d^2 x / dq_j dq_k = w_a x (w_b x (x - o_b)) = w_a x J_b, where b is the other one.
+	int n = (int)J0.cols();
+	computeJointAxes(*p0, w0);
+	computeJointAxes(*p1, w1);
+	W0 = mu00 * J0;
+	W0 += mu01 * J1;
+	W1 = mu01 * J0;
+	W1 += mu11 * J1;
+	dM.resize(n);
+	df.resize(n, n);
+	dJ0.resize(3, n);
+	dJ1.resize(3, n);
+
+	for (int k = 0; k < n; ++k) {
+		for (int j = 0; j < n; ++j) {
+			// Joints off the path have zero axes, so their columns vanish
+			if (k <= j) {
+				dJ0.col(j) = Vector3d(w0.col(k)).cross(Vector3d(J0.col(j)));
+				dJ1.col(j) = Vector3d(w1.col(k)).cross(Vector3d(J1.col(j)));
+			}
+			else {
+				dJ0.col(j) = Vector3d(w0.col(j)).cross(Vector3d(J0.col(k)));
+				dJ1.col(j) = Vector3d(w1.col(j)).cross(Vector3d(J1.col(k)));
+			}
+		}
+		P.noalias() = dJ0.transpose() * W0;
+		P.noalias() += dJ1.transpose() * W1;
+		dM[k] = P;
+		dM[k] += P.transpose();
+		df.col(k).noalias() = dJ0.transpose() * (mu0 * grav);
+		df.col(k).noalias() += dJ1.transpose() * (mu1 * grav);
+	}
+}
+
+void Spring::computeJointAxes(const Particle &p, MatrixXd &w) const {
+	// World axis of every joint between the point and the root, zero elsewhere
+	w.setZero(3, J0.cols());
+	for (const Rigid *b = p.getParent().get(); b->getIndex() != 0; b = b->getParent().get()) {
+		Matrix4d E_W_J = b->getParent()->getE() * b->getJoint()->getE_P_J();
+		w.col(b->getIndex() - 1) = E_W_J.block<3, 1>(0, 2);
+	}
+}
+
 double Spring::computeLength() {
 	this->l = (p0->x - p1->x).norm();
 	return this->l;
 }
 
 void Spring::updateSamplesPosition() {
-	for (int i = 0; i < (int)this->samples.size(); ++i) {
-		auto sample = samples[i];
-		double s = sample->s;
-		sample->x = (1 - s)*p0->x + s*p1->x;
+	samples.updatePosition(p0->x, p1->x);
+}
+
+void Spring::updateSamplesJacobian(const vector<shared_ptr<Joint>> &joints) {
+	if (isCheckJacobian) {
+		cout << "Jacobian error: " << checkJacobian(joints) << endl;
+	}
+
+	if (isAnalyticJacobian) {
+		updateSamplesJacobianAnalytic(joints);
+	}
+	else {
+		updateSamplesJacobianFD();
+	}
+}
+
+void Spring::computeEndpointJacobians(const vector<shared_ptr<Joint>> &joints) {
+	auto b0 = p0->getParent();
+	auto b1 = p1->getParent();
+
+	if (isReduced) {
+		// Reduced Coordinate
+		int num_joints = (int)joints.size();
+		b0->computePointJacobian(p0->x0, num_joints, J0);
+		b1->computePointJacobian(p1->x0, num_joints, J1);
+	}
+	else {
+		// Maximal Coordinate
+		// The derivative of E * exp([pert]) * x0 wrt pert is R * gamma(x0)
+		J0.resize(3, 12);
+		J1.resize(3, 12);
+		J0.setZero();
+		J1.setZero();
+		J0.block<3, 6>(0, 0) = b0->getR() * Rigid::gamma(p0->x0);
+		J1.block<3, 6>(0, 6) = b1->getR() * Rigid::gamma(p1->x0);
 	}
 }
 
-void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
+void Spring::updateSamplesJacobianAnalytic(const vector<shared_ptr<Joint>> &joints) {
+	auto b0 = p0->getParent();
+	auto b1 = p1->getParent();
+
+	// Used to compute velocity of samples and energy
+	if (isReduced) {
+		Joint::getThetadotVector(joints, thetadotlist);
+	}
+	else {
+		phi_box.segment<6>(0) = b0->getTwist();
+		phi_box.segment<6>(6) = b1->getTwist();
+	}
+
+	computeEndpointJacobians(joints);
+	if (isMomentInertia) {
+		return;
+	}
+
+	// Every sample is (1 - s) * p0 + s * p1
+	samples.setJacobianLinear(J0, J1);
+}
+
+double Spring::checkJacobian(const vector<shared_ptr<Joint>> &joints) {
+	// Max difference between the closed-form and the finite difference sample Jacobians
+	updateSamplesJacobianFD();
+	computeEndpointJacobians(joints);
+
+	double err = 0.0;
+	for (int isample = 0; isample < samples.size(); ++isample) {
+		double s = samples.s(isample);
+		MatrixXd J_fd = samples.jacobian(isample);
+		MatrixXd J_ii = (1 - s) * J0 + s * J1;
+		if (J_fd.cols() != J_ii.cols()) {
+			// The finite difference path only handles the two joints of its boxes
+			J_ii = J_ii.leftCols(J_fd.cols()).eval();
+		}
+		err = max(err, (J_fd - J_ii).cwiseAbs().maxCoeff());
+	}
+	return err;
+}
+
+void Spring::updateSamplesJacobianFD() {
 	
 
 	if (isReduced) {
@@ -137,11 +373,7 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 		//	}
 		//}
 
-		MatrixXd J(3, 2);
-		J.setZero();
-		for (int i = 0; i < (int)samples.size(); ++i) {		
-			samples[i]->setJacobianMatrix(J);
-		}
+		samples.resizeJacobian(2);
 
 		auto b0 = p0->getParent();
 		auto b1 = p1->getParent();
@@ -153,6 +385,7 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 		// Used to compute velocity of samples and energy
 		thetadot(0) = b0->getThetadot();
 		thetadot(1) = b1->getThetadot();
+		thetadotlist = thetadot;
 		Vector2d pert;
 		// For two angles add a small perturbation
 		pert = theta;
@@ -163,15 +396,12 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 		b0->updateTempPoints();
 		b1->updateTempPoints();
 
-		for (int isample = 0; isample < (int)samples.size(); ++isample) {
-			auto sample = samples[isample];
-			double s = sample->s;
+		for (int isample = 0; isample < samples.size(); ++isample) {
+			double s = samples.s(isample);
 
-			Vector3d p_nopert = sample->x;
 			Vector3d p_pert = (1 - s) * p0->getTempPos() + s * p1->getTempPos();
 			//Vector3d p_pert = (1 - s) * p0->getTempPos() + s * p1->x;
-			Vector3d diff = (p_pert - sample->x) / epsilon;
-			sample->setJacobianMatrixCol(diff, 0);
+			samples.jacobian(isample).col(0) = (p_pert - samples.x.col(isample)) / epsilon;
 		}
 
 		pert = theta;
@@ -180,15 +410,11 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 		b1->setSingleJointAngle(pert(1));
 		b1->updateTempPoints();
 
-		for (int isample = 0; isample < (int)samples.size(); ++isample) {
-			auto sample = samples[isample];
-			double s = sample->s;
+		for (int isample = 0; isample < samples.size(); ++isample) {
+			double s = samples.s(isample);
 
-			Vector3d p_nopert = sample->x;
 			Vector3d p_pert = (1 - s) * p0->x + s * p1->getTempPos();
-
-			Vector3d diff = (p_pert - sample->x) / epsilon;
-			sample->setJacobianMatrixCol(diff, 1);
+			samples.jacobian(isample).col(1) = (p_pert - samples.x.col(isample)) / epsilon;
 		}
 
 		// Check with the formula
@@ -213,6 +439,7 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 		phi_box.segment<6>(0) = b0->getTwist();
 		phi_box.segment<6>(6) = b1->getTwist();
 
+		samples.resizeJacobian(12);
 		Vector6d pert;
 
 		// For each component of phi(i = 0, 1, 2..,11) add a relative small perturbation
@@ -222,19 +449,15 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 			pert(ii) += epsilon;
 
 			// Compute new configuration
-			Matrix4d E_pert = b0->getE() * Rigid::bracket6(pert).exp();
+			Matrix4d E_pert = b0->getE() * SE3::exp(pert);
 			b0->setEtemp(E_pert);
 			b0->updateTempPoints();
 
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				double s = sample->s;
+			for (int isample = 0; isample < samples.size(); ++isample) {
+				double s = samples.s(isample);
 
-				Vector3d p_nopert = sample->x;
 				Vector3d p_pert = (1 - s) * p0->getTempPos() + s * p1->x;
-
-				Vector3d diff = (p_pert - sample->x) / epsilon;
-				sample->setJacobianMatrixCol(diff, ii);
+				samples.jacobian(isample).col(ii) = (p_pert - samples.x.col(isample)) / epsilon;
 			}
 		}
 
@@ -244,16 +467,14 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 			pert(ii) += epsilon;
 
 			// Compute new configuration
-			Matrix4d E_pert = b1->getE() * Rigid::bracket6(pert).exp();
+			Matrix4d E_pert = b1->getE() * SE3::exp(pert);
 			b1->setEtemp(E_pert);
 			b1->updateTempPoints();
 
 			// Fill in the ii-th column of Jacobian
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				double s = sample->s;
+			for (int isample = 0; isample < samples.size(); ++isample) {
+				double s = samples.s(isample);
 
-				Vector3d p_nopert = sample->x;
 				Vector3d p_pert = (1 - s) * p0->x + s * p1->getTempPos();
 				
 				/*if (ii == 0) {
@@ -262,156 +483,272 @@ void Spring::updateSamplesJacobian(vector<shared_ptr<Joint>> joints) {
 					debug_points.push_back(debug);
 				}*/
 				
-
-				Vector3d diff = (p_pert - sample->x) / epsilon;
-				sample->setJacobianMatrixCol(diff, ii + 6);
+				samples.jacobian(isample).col(ii + 6) = (p_pert - samples.x.col(isample)) / epsilon;
 			}
 		}
 	}
 }
 
 void Spring::computeEnergy() {
-	this->V = 0.0;
-	this->K = 0.0;
-	double V_ii, K_ii;
-
-	for (int isample = 0; isample < (int)samples.size(); ++isample) {
-		auto sample = samples[isample];
-
-		// Update the energy	
-		V_ii = sample->computePotentialEnergy(grav);
+	// V = m g.x is the negative of the potential (K - V is conserved), so the
+	// elastic energy is subtracted
+	if (isMomentInertia || !isSamplesCurrent) {
+		Vector3d v0, v1;
 		if (isReduced) {
-			//K_ii = sample->computeKineticEnergy(thetadotlist);
-			K_ii = sample->computeKineticEnergy(thetadot);
+			v0.noalias() = J0 * thetadotlist;
+			v1.noalias() = J1 * thetadotlist;
 		}
 		else {
-			K_ii = sample->computeKineticEnergy(phi_box);
-		}		
+			v0.noalias() = J0 * phi_box;
+			v1.noalias() = J1 * phi_box;
+		}
+		this->V = grav.dot(mu0 * p0->x + mu1 * p1->x) - computeElasticEnergy();
+		this->K = 0.5 * (mu00 * v0.dot(v0) + 2.0 * mu01 * v0.dot(v1) + mu11 * v1.dot(v1));
+		return;
+	}
 
-		this->V += V_ii;
-		this->K += K_ii;
+	this->V = samples.computePotentialEnergy(grav) - computeElasticEnergy();
+	if (isReduced) {
+		this->K = samples.computeKineticEnergy(thetadotlist);
+	}
+	else {
+		this->K = samples.computeKineticEnergy(phi_box);
 	}
 }
 
-MatrixXd Spring::computeMassMatrix(vector<shared_ptr<Spring> > springs, int num_boxes, bool isReduced) {
-	if (isReduced) {
-		
+MatrixXd Spring::computeMassMatrix(const vector<shared_ptr<Spring> > &springs, int num_boxes, bool isReduced) {
+	MatrixXd M_s;
+	computeMassMatrix(springs, num_boxes, isReduced, M_s);
+	return M_s;
+}
+
+VectorXd Spring::computeGravity(const vector<shared_ptr<Spring> > &springs, int num_boxes, bool isReduced) {
+	VectorXd b_s;
+	computeGravity(springs, num_boxes, isReduced, b_s);
+	return b_s;
+}
 
+void Spring::computeMassMatrix(const vector<shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, MatrixXd &M_s) {
+	// M_s is only reallocated when its size changes
+	if (isReduced) {
 		int n = num_boxes - 1;
-		MatrixXd M_s(n, n);
+		M_s.resize(n, n);
 		M_s.setZero();
 
 		for (int i = 0; i < (int)springs.size(); ++i) {
 			auto spring = springs[i];
-
-			/*auto b0 = spring->p0->getParent();
-			auto b1 = spring->p1->getParent();
-
-			Vector2d theta;
-			theta(0) = b0->getAngle();
-			theta(1) = b1->getAngle();
-*/
-
-
-			auto samples = spring->getSamples();
-
-			// Sum up the inertia matrix of all the sample points
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				MatrixXd J_ii = sample->getJacobianMatrix();
-				MatrixXd M_ii = J_ii.transpose() * J_ii * sample->m;
-			
-				// Fill in Mass matrix
-				M_s += M_ii;
+			if (spring->isInertiaCached()) {
+				M_s += spring->M_eval;
+			}
+			else if (spring->isMomentInertia) {
+				spring->addMomentMassMatrix(M_s);
+			}
+			else {
+				// Inertia of all the sample points at the last refresh
+				M_s += spring->M_samples;
 			}
-
-			// Check if the inertia of the muscle is the same 
-			/*Matrix2d checkIm;
-			double l = 4.0; 
-			double r = l * 0.1;
-			checkIm << l * l + r * r + 2 * l * r * cos(theta(1)), r *r + l *r* cos(theta(1)),
-				r * r + l * r * cos(theta(1)), r * r;
-			checkIm *= 4.2 / 3.0;
-			cout << "computed:"<< M_s << endl;
-			cout << "shouldbe:" << checkIm << endl;*/
-			// the inertia of the muscle is correct
 		}
-		return M_s;
 	}
 	else {
 		int n = 6 * num_boxes;
-		MatrixXd M_s(n, n);
+		M_s.resize(n, n);
 		M_s.setZero();
 
 		for (int i = 0; i < (int)springs.size(); ++i) {
 			auto spring = springs[i];
-			auto samples = spring->getSamples();
 			Vector2d box_id = spring->getBoxID();
 
-			// Sum up the inertia matrix of all the sample points
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				Matrix3x12d J_ii = sample->getJacobianMatrix();
-				Matrix12d M_ii = J_ii.transpose() * J_ii * sample->m;
-
-				// Fill in Mass matrix
-				M_s.block<6, 6>(6 * box_id(0), 6 * box_id(0)) += M_ii.block<6, 6>(0, 0);
-				M_s.block<6, 6>(6 * box_id(0), 6 * box_id(1)) += M_ii.block<6, 6>(0, 6);
-				M_s.block<6, 6>(6 * box_id(1), 6 * box_id(0)) += M_ii.block<6, 6>(6, 0);
-				M_s.block<6, 6>(6 * box_id(1), 6 * box_id(1)) += M_ii.block<6, 6>(6, 6);
-			}
+			Matrix12d M_ii;
+			spring->computeBoxMassMatrix(M_ii);
+
+			// Fill in Mass matrix
+			M_s.block<6, 6>(6 * box_id(0), 6 * box_id(0)) += M_ii.block<6, 6>(0, 0);
+			M_s.block<6, 6>(6 * box_id(0), 6 * box_id(1)) += M_ii.block<6, 6>(0, 6);
+			M_s.block<6, 6>(6 * box_id(1), 6 * box_id(0)) += M_ii.block<6, 6>(6, 0);
+			M_s.block<6, 6>(6 * box_id(1), 6 * box_id(1)) += M_ii.block<6, 6>(6, 6);
 		}
-		return M_s;
-	}	
+	}
 }
 
-VectorXd Spring::computeGravity(vector<shared_ptr<Spring> > springs, int num_boxes, bool isReduced) {
+void Spring::computeGravity(const vector<shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, VectorXd &b_s) {
 	if (isReduced) {
 		int n = num_boxes - 1;
-		VectorXd b_s(n);
+		b_s.resize(n);
 		b_s.setZero();
 		for (int i = 0; i < (int)springs.size(); ++i) {
 			auto spring = springs[i];
-			auto samples = spring->getSamples();
-			
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				MatrixXd J_ii = sample->getJacobianMatrix();
-
-				// Add gravtiy force for each sample to b vector
-				VectorXd f_ii = J_ii.transpose() * sample->m * spring->grav;
-				b_s += f_ii;
+			if (spring->isInertiaCached()) {
+				b_s += spring->f_eval;
+			}
+			else if (spring->isMomentInertia) {
+				spring->addMomentGravity(b_s);
+			}
+			else {
+				// Gravity of all the sample points at the last refresh, like the inertia
+				b_s += spring->f_samples;
 			}
 		}
-		return b_s;
 	}
 	else {
 		int n = 6 * num_boxes;
-		VectorXd b_s(n);
+		b_s.resize(n);
 		b_s.setZero();
 
 		for (int i = 0; i < (int)springs.size(); ++i) {
 			auto spring = springs[i];
-			auto samples = spring->getSamples();
 			Vector2d box_id = spring->getBoxID();
 
-			for (int isample = 0; isample < (int)samples.size(); ++isample) {
-				auto sample = samples[isample];
-				Matrix3x12d J_ii = sample->getJacobianMatrix();
-
+			Vector12d f_ii;
+			f_ii.setZero();
+			if (spring->isMomentInertia) {
+				spring->addMomentGravity(f_ii);
+			}
+			else {
 				// Add gravtiy force for each sample to b vector
-				Vector12d f_ii = J_ii.transpose() * sample->m * spring->grav;
-
-				b_s.segment<6>(6 * box_id(0)) += f_ii.segment<6>(0);
-				b_s.segment<6>(6 * box_id(1)) += f_ii.segment<6>(6);
+				spring->getSamples().addGravity(f_ii, spring->grav);
 			}
+
+			b_s.segment<6>(6 * box_id(0)) += f_ii.segment<6>(0);
+			b_s.segment<6>(6 * box_id(1)) += f_ii.segment<6>(6);
+		}
+	}
+}
+
+void Spring::computeBoxMassMatrix(Matrix12d &M_ii) const {
+	// Maximal coord, the inertia over the twists of the two boxes the spring is attached to
+	M_ii.setZero();
+	if (isMomentInertia) {
+		addMomentMassMatrix(M_ii);
+	}
+	else {
+		// Sum up the inertia matrix of all the sample points
+		samples.addMassMatrix(M_ii);
+	}
+}
+
+MatrixXd Spring::computeMomentMassMatrix() const {
+	MatrixXd M = MatrixXd::Zero(J0.cols(), J0.cols());
+	addMomentMassMatrix(M);
+	return M;
+}
+
+VectorXd Spring::computeMomentGravity() const {
+	VectorXd f = VectorXd::Zero(J0.cols());
+	addMomentGravity(f);
+	return f;
+}
+
+void Spring::addMomentMassMatrix(Ref<MatrixXd> M) const {
+	// sum_i m_i J_i^T J_i with J_i = (1 - s_i) J0 + s_i J1, exact for a straight spring
+	M.noalias() += mu00 * J0.transpose() * J0;
+	M.noalias() += mu01 * J0.transpose() * J1;
+	M.noalias() += mu01 * J1.transpose() * J0;
+	M.noalias() += mu11 * J1.transpose() * J1;
+}
+
+void Spring::addMomentGravity(Ref<VectorXd> f) const {
+	// sum_i J_i^T m_i g
+	f.noalias() += J0.transpose() * (mu0 * grav);
+	f.noalias() += J1.transpose() * (mu1 * grav);
+}
+
+void Spring::computeElasticForce(const vector<shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, VectorXd &f_e) {
+	f_e.resize(isReduced ? num_boxes - 1 : 6 * num_boxes);
+	f_e.setZero();
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		auto spring = springs[i];
+		if (!spring->isElastic) {
+			continue;
+		}
+		if (isReduced) {
+			spring->addElasticForce(f_e);
+		}
+		else {
+			Vector2d box_id = spring->getBoxID();
+			Vector12d f_ii;
+			f_ii.setZero();
+			spring->addElasticForce(f_ii);
+			f_e.segment<6>(6 * box_id(0)) += f_ii.segment<6>(0);
+			f_e.segment<6>(6 * box_id(1)) += f_ii.segment<6>(6);
+		}
+	}
+}
+
+void Spring::computeStiffnessMatrix(const vector<shared_ptr<Spring> > &springs, int num_boxes, MatrixXd &K_e) {
+	// Only used in reduced coord
+	int n = num_boxes - 1;
+	K_e.resize(n, n);
+	K_e.setZero();
+	for (int i = 0; i < (int)springs.size(); ++i) {
+		if (springs[i]->isElastic) {
+			springs[i]->addStiffnessMatrix(K_e);
 		}
-		return b_s;
 	}
- }
+}
+
+double Spring::computeElasticEnergy() const {
+	if (!isElastic) {
+		return 0.0;
+	}
+	double dl = (p1->x - p0->x).norm() - L;
+	return 0.5 * E * dl * dl;
+}
 
+void Spring::addElasticForce(Ref<VectorXd> f) const {
+	// f = -E (l - L) dl/dq, with dl/dq = u^T (J1 - J0) and u the unit vector from p0 to p1
+	Vector3d dx = p1->x - p0->x;
+	double len = dx.norm();
+	Vector3d u = dx / len;
+	double c = E * (len - L);
+	f.noalias() -= J1.transpose() * (c * u);
+	f.noalias() += J0.transpose() * (c * u);
+}
+
+void Spring::addStiffnessMatrix(Ref<MatrixXd> K) {
+	// K = d^2 V / dq^2 = E g g^T + E (l - L) d^2 l / dq^2, with g = dl/dq = D^T u and D = J1 - J0.
+	// d^2 l / dq^2 = D^T (I - u u^T) D / l + u . d^2 (x1 - x0) / dq^2, and the first parts
+	// combine into D^T P D with P = E u u^T + E (l - L) / l (I - u u^T).
+	Vector3d dx = p1->x - p0->x;
+	double len = dx.norm();
+	Vector3d u = dx / len;
+	double c = E * (len - L);
+	Matrix3d uu = u * u.transpose();
+	Matrix3d P = E * uu + (c / len) * (Matrix3d::Identity() - uu);
+
+	D = J1;
+	D -= J0;
+	PD.noalias() = P * D;
+	K.noalias() += D.transpose() * PD;
+
+	addEndpointCurvature(*p1, c, u, K);
+	addEndpointCurvature(*p0, -c, u, K);
+}
+
+void Spring::addEndpointCurvature(const Particle &p, double c, const Vector3d &u, Ref<MatrixXd> K) const {
+	// K_ab += c u . d^2 x / dq_a dq_b. For revolute joints a and b on the way from the point
+	// down to the root, with b the one nearer the root,
+	// d^2 x / dq_a dq_b = w_b x (w_a x (x - o_a)), where w is the joint axis and o its origin.
+	for (const Rigid *ba = p.getParent().get(); ba->getIndex() != 0; ba = ba->getParent().get()) {
+		Matrix4d E_W_Ja = ba->getParent()->getE() * ba->getJoint()->getE_P_J();
+		Vector3d w_a = E_W_Ja.block<3, 1>(0, 2);
+		Vector3d v_a = w_a.cross(p.x - E_W_Ja.block<3, 1>(0, 3));
+		int a = ba->getIndex() - 1;
+
+		for (const Rigid *bb = ba; bb->getIndex() != 0; bb = bb->getParent().get()) {
+			Matrix4d E_W_Jb = bb->getParent()->getE() * bb->getJoint()->getE_P_J();
+			Vector3d w_b = E_W_Jb.block<3, 1>(0, 2);
+			int b = bb->getIndex() - 1;
+			double k = c * u.dot(w_b.cross(v_a));
+			K(a, b) += k;
+			if (a != b) {
+				K(b, a) += k;
+			}
+		}
+	}
+}
 
 void Spring::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 
 	prog->bind();
 	glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
@@ -456,6 +793,7 @@ void Spring::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program
 
 	MV->popMatrix();
 	prog2->unbind();
+#endif
 }
 
 Spring::~Spring()
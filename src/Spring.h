@@ -7,6 +7,7 @@
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 #include "MLCommon.h"
+#include "SpringSamples.h"
 
 class Program;
 class MatrixStack;
@@ -19,23 +20,63 @@ class Spring
 public:
 	Spring(std::shared_ptr<Particle> p0, std::shared_ptr<Particle> p1, double _mass, int num_samples, Eigen::Vector3d _grav, double _epsilon, bool _isReduced, double _stiffness);
 	virtual ~Spring();
-	void step(std::vector<std::shared_ptr<Joint>> joints);
+	void step(const std::vector<std::shared_ptr<Joint>> &joints);
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
-	void setSamples(std::vector < std::shared_ptr<Particle> > _samples) { this->samples = _samples; }
 	void updateSamplesPosition();
-	void updateSamplesJacobian(std::vector<std::shared_ptr<Joint>> joints);
-	
+	void updateSamplesJacobian(const std::vector<std::shared_ptr<Joint>> &joints);
+	void updateSamplesJacobianFD();
+	void updateSamplesJacobianAnalytic(const std::vector<std::shared_ptr<Joint>> &joints);
+	void computeEndpointJacobians(const std::vector<std::shared_ptr<Joint>> &joints);
+	double checkJacobian(const std::vector<std::shared_ptr<Joint>> &joints);
+
+	void setAnalyticJacobian(bool _isAnalyticJacobian) { this->isAnalyticJacobian = _isAnalyticJacobian; }
+	void setCheckJacobian(bool _isCheckJacobian) { this->isCheckJacobian = _isCheckJacobian; }
+	void setMomentInertia(bool _isMomentInertia) { this->isMomentInertia = _isMomentInertia; }
+	void setElastic(bool _isElastic) { this->isElastic = _isElastic; }
+	void setRefreshTolerance(double _refresh_tol) { this->refresh_tol = _refresh_tol; }
+	int getNumRefreshes() const { return this->num_refreshes; }
+	int getNumSteps() const { return this->num_steps; }
+	void setCacheTolerance(double _cache_tol) { this->cache_tol = _cache_tol; }
+	int getNumCacheHits() const { return this->num_hits; }
+	int getNumCacheMisses() const { return this->num_misses; }
+
+	// Step and cache counters, saved with the scene state so that rejected adaptive steps do not count
+	struct Counters {
+		int num_steps;
+		int num_refreshes;
+		int num_hits;
+		int num_misses;
+	};
+	Counters getCounters() const;
+	void setCounters(const Counters &counters);
+	// The next step refreshes the samples and rebuilds the inertia cache
+	void invalidate() { this->isStale = true; }
+
 	
 	Vector12d getBoxTwists() const { return this->phi_box; }
 	Eigen::Vector2d getBoxID() const { return this->box_id; };
+	Eigen::MatrixXd getJ0() const { return this->J0; }
+	Eigen::MatrixXd getJ1() const { return this->J1; }
 	double getPotentialEnergy() const { return this->V; }
 	double getKineticEnergy() const { return this->K; }
-	std::vector<std::shared_ptr<Particle> > getSamples() const { return this->samples; }
+	const SpringSamples &getSamples() const { return this->samples; }
 
 	double computeLength();
 	void computeEnergy();
-	static Eigen::MatrixXd computeMassMatrix(std::vector<std::shared_ptr<Spring> > springs, int num_boxes, bool isReduced);
-	static Eigen::VectorXd computeGravity(std::vector<std::shared_ptr<Spring> > springs, int num_boxes, bool isReduced);
+	static Eigen::MatrixXd computeMassMatrix(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, bool isReduced);
+	static Eigen::VectorXd computeGravity(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, bool isReduced);
+	static void computeMassMatrix(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, Eigen::MatrixXd &M_s);
+	static void computeGravity(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, Eigen::VectorXd &b_s);
+	void computeBoxMassMatrix(Matrix12d &M_ii) const;
+	Eigen::MatrixXd computeMomentMassMatrix() const;
+	Eigen::VectorXd computeMomentGravity() const;
+	void addMomentMassMatrix(Eigen::Ref<Eigen::MatrixXd> M) const;
+	void addMomentGravity(Eigen::Ref<Eigen::VectorXd> f) const;
+	static void computeElasticForce(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, bool isReduced, Eigen::VectorXd &f_e);
+	static void computeStiffnessMatrix(const std::vector<std::shared_ptr<Spring> > &springs, int num_boxes, Eigen::MatrixXd &K_e);
+	double computeElasticEnergy() const;
+	void addElasticForce(Eigen::Ref<Eigen::VectorXd> f) const;
+	void addStiffnessMatrix(Eigen::Ref<Eigen::MatrixXd> K);
 
 	std::shared_ptr<Particle> p0;
 	std::shared_ptr<Particle> p1;
@@ -48,14 +89,76 @@ public:
 	double V;
 	double K;
 
-	std::vector<std::shared_ptr<Particle> > samples;	// sample points along the spring
+	SpringSamples samples;	// sample points along the spring
 	Eigen::Vector3d grav;
 	Eigen::Vector2d box_id;
 	Vector12d phi_box;	
 	Eigen::VectorXd thetadotlist;
 	Eigen::Vector2d thetadot;
 	bool isReduced;
+	bool isAnalyticJacobian;	// closed-form sample Jacobians instead of finite difference
+	bool isCheckJacobian;		// compare the closed-form Jacobians against finite difference
+	bool isMomentInertia;		// assemble inertia and gravity from the sample moments, skip the samples
+	bool isElastic;				// the endpoints are pulled together by the energy E (l - L)^2 / 2
+	bool isSamplesCurrent;		// the samples were refreshed in the last step
+	bool isStale;				// the sample and inertia caches belong to a discarded state
+	double refresh_tol;			// endpoint drift, relative to L, before the reduced sample inertia is refreshed
+	double cache_tol;			// joint angle change before the reduced sample inertia cache is rebuilt, 0 disables it
+	Eigen::MatrixXd J0;			// Jacobian of p0
+	Eigen::MatrixXd J1;			// Jacobian of p1
+
+	// Mass moments of the samples, fixed since s and m never change
+	double mu0;		// sum m (1 - s)
+	double mu1;		// sum m s
+	double mu00;	// sum m (1 - s)^2
+	double mu01;	// sum m s (1 - s)
+	double mu11;	// sum m s^2
 	std::vector< std::shared_ptr<Particle> > debug_points;
+
+private:
+	bool needsRefresh() const;
+	bool isCacheMiss() const;
+	// The Taylor cache only stands in for the pass over the samples. The moment inertia is
+	// exact from four rank 3 products, O(n^2) per spring, while the update adds n matrices
+	// dtheta_k dM_k, O(n^3). ArticulatedBody never forms M_s: it keeps each spring as the
+	// n x 6 factor U_s and solves through Woodbury, which a dense M_s would undo.
+	bool isInertiaCached() const { return isReduced && cache_tol > 0.0 && !isMomentInertia; }
+	void updateInertiaCache(const std::vector<std::shared_ptr<Joint>> &joints);
+	void computeInertiaGradients();
+	void computeJointAxes(const Particle &p, Eigen::MatrixXd &w) const;
+	void addEndpointCurvature(const Particle &p, double c, const Eigen::Vector3d &u, Eigen::Ref<Eigen::MatrixXd> K) const;
+
+	// Workspace for addStiffnessMatrix()
+	Eigen::MatrixXd D;	// J1 - J0
+	Eigen::MatrixXd PD;
+
+	// Endpoints and reduced sample inertia and gravity at the last sample refresh
+	Eigen::Vector3d x0_refresh;
+	Eigen::Vector3d x1_refresh;
+	Eigen::MatrixXd M_samples;
+	Eigen::VectorXd f_samples;
+	int num_refreshes;
+	int num_steps;
+
+	// Reduced inertia and gravity at theta_cache with their gradients wrt the joint angles,
+	// and the first order estimate at the current angles
+	Eigen::VectorXd thetalist;
+	Eigen::VectorXd theta_cache;
+	Eigen::VectorXd dtheta;
+	Eigen::MatrixXd M_cache;
+	Eigen::VectorXd f_cache;
+	std::vector<Eigen::MatrixXd> dM;	// dM / dtheta_k
+	Eigen::MatrixXd df;					// column k is df / dtheta_k
+	Eigen::MatrixXd M_eval;
+	Eigen::VectorXd f_eval;
+	int num_hits;
+	int num_misses;
+
+	// Workspace for computeInertiaGradients()
+	Eigen::MatrixXd w0, w1;			// world joint axes on the way from p0 and p1 to the root
+	Eigen::MatrixXd dJ0, dJ1;
+	Eigen::MatrixXd W0, W1;			// mu00 J0 + mu01 J1 and mu01 J0 + mu11 J1
+	Eigen::MatrixXd P;
 };
 
 #endif // MUSCLEMASS_SRC_SPRING_H_
@@ -0,0 +1,86 @@
+#include "SpringSamples.h"
+
+using namespace std;
+using namespace Eigen;
+
+SpringSamples::SpringSamples() :
+	cols(0)
+{
+
+}
+
+void SpringSamples::init(double mass, int num_samples) {
+	s.resize(num_samples);
+	m.resize(num_samples);
+	x.resize(3, num_samples);
+	x.setZero();
+	J.resize(3, 0);
+	cols = 0;
+
+	double dm = mass / num_samples;
+	for (int i = 0; i < num_samples; ++i) {
+		s(i) = i / double(num_samples - 1);
+		m(i) = dm;
+	}
+}
+
+void SpringSamples::updatePosition(const Vector3d &x0, const Vector3d &x1) {
+	// x_i = (1 - s_i) x0 + s_i x1
+	x.noalias() = x0 * (1.0 - s.array()).matrix().transpose();
+	x.noalias() += x1 * s.transpose();
+}
+
+void SpringSamples::resizeJacobian(int _cols) {
+	// Keep the buffer when the shape does not change
+	if (_cols != cols || J.cols() != _cols * size()) {
+		cols = _cols;
+		J.resize(3, cols * size());
+	}
+	J.setZero();
+}
+
+void SpringSamples::setJacobianLinear(const MatrixXd &J0, const MatrixXd &J1) {
+	// J_i = (1 - s_i) J0 + s_i J1
+	if (J0.cols() != cols || J.cols() != cols * size()) {
+		cols = (int)J0.cols();
+		J.resize(3, cols * size());
+	}
+	for (int i = 0; i < size(); ++i) {
+		jacobian(i).noalias() = (1 - s(i)) * J0 + s(i) * J1;
+	}
+}
+
+double SpringSamples::computePotentialEnergy(const Vector3d &grav) const {
+	return grav.dot(x * m);
+}
+
+double SpringSamples::computeKineticEnergy(const Ref<const VectorXd> &phi) const {
+	assert(phi.size() == cols);
+	double K = 0.0;
+	for (int i = 0; i < size(); ++i) {
+		Vector3d v = jacobian(i) * phi;
+		K += 0.5 * m(i) * v.squaredNorm();
+	}
+	return K;
+}
+
+void SpringSamples::addMassMatrix(Ref<MatrixXd> M) const {
+	// M += sum_i m_i J_i^T J_i
+	assert(M.rows() == cols && M.cols() == cols);
+	for (int i = 0; i < size(); ++i) {
+		M.noalias() += m(i) * jacobian(i).transpose() * jacobian(i);
+	}
+}
+
+void SpringSamples::addGravity(Ref<VectorXd> f, const Vector3d &grav) const {
+	// f += sum_i J_i^T m_i g
+	assert(f.size() == cols);
+	for (int i = 0; i < size(); ++i) {
+		f.noalias() += jacobian(i).transpose() * (m(i) * grav);
+	}
+}
+
+SpringSamples::~SpringSamples()
+{
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_SPRINGSAMPLES_H_
+#define MUSCLEMASS_SRC_SPRINGSAMPLES_H_
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+// Packed storage of the sample points along a muscle line.
+// Sample i owns column i of s, m, x and the columns [i*cols, (i+1)*cols) of J.
+class SpringSamples
+{
+public:
+	SpringSamples();
+	virtual ~SpringSamples();
+	void init(double mass, int num_samples);
+	void updatePosition(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1);
+	void resizeJacobian(int _cols);
+	void setJacobianLinear(const Eigen::MatrixXd &J0, const Eigen::MatrixXd &J1);
+
+	int size() const { return (int)this->s.size(); }
+	int getJacobianCols() const { return this->cols; }
+	Eigen::Block<Eigen::Matrix3Xd, 3, Eigen::Dynamic, true> jacobian(int i) { return this->J.middleCols(i * cols, cols); }
+	const Eigen::Block<const Eigen::Matrix3Xd, 3, Eigen::Dynamic, true> jacobian(int i) const { return this->J.middleCols(i * cols, cols); }
+
+	double computePotentialEnergy(const Eigen::Vector3d &grav) const;
+	double computeKineticEnergy(const Eigen::Ref<const Eigen::VectorXd> &phi) const;
+	void addMassMatrix(Eigen::Ref<Eigen::MatrixXd> M) const;
+	void addGravity(Eigen::Ref<Eigen::VectorXd> f, const Eigen::Vector3d &grav) const;
+
+	Eigen::VectorXd s;		// non-dimensional material coordinate [0,1], fixed
+	Eigen::VectorXd m;		// mass of each sample, fixed
+	Eigen::Matrix3Xd x;		// position of each sample
+	Eigen::Matrix3Xd J;		// Jacobian of each sample, stored side by side
+
+private:
+	int cols;				// number of columns of a single sample Jacobian
+};
+
+#endif // MUSCLEMASS_SRC_SPRINGSAMPLES_H_
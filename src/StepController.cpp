@@ -0,0 +1,73 @@
+#include "StepController.h"
+
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Joint.h"
+
+using namespace std;
+using namespace Eigen;
+
+StepController::StepController(double _h, double _h_min, double _h_max, double _tol) :
+	h(_h),
+	h_min(_h_min),
+	h_max(_h_max),
+	tol(_tol),
+	num_accepted(0),
+	num_rejected(0),
+	h_accepted_min(numeric_limits<double>::infinity()),
+	h_accepted_max(0.0),
+	t_accepted(0.0)
+{
+	h = min(h_max, max(h_min, h));
+}
+
+double StepController::getStepSize(const vector< shared_ptr<Joint> > &joints) const {
+	double hh = h;
+	for (int i = 0; i < (int)joints.size(); ++i) {
+		double theta = joints[i]->getTheta();
+		double thetadot = joints[i]->getThetadot();
+		double min_theta = joints[i]->getMinTheta();
+		double max_theta = joints[i]->getMaxTheta();
+		if (theta <= min_theta || theta >= max_theta || thetadot == 0.0) {
+			continue;
+		}
+		// Closer than sqrt(tol) the joint is allowed to reach the limit, otherwise the
+		// steps would keep halving until h_min
+		double dist = thetadot > 0.0 ? max_theta - theta : theta - min_theta;
+		hh = min(hh, 0.5 * max(dist, sqrt(tol)) / abs(thetadot));
+	}
+	return max(h_min, hh);
+}
+
+bool StepController::update(double hh, double err) {
+	// Local error of a first order method is O(h^2)
+	double factor = err > 0.0 ? 0.9 * sqrt(tol / err) : 2.0;
+	factor = min(2.0, max(0.2, factor));
+	h = min(h_max, max(h_min, hh * factor));
+
+	if (err > tol && hh > h_min) {
+		num_rejected++;
+		return false;
+	}
+	num_accepted++;
+	h_accepted_min = min(h_accepted_min, hh);
+	h_accepted_max = max(h_accepted_max, hh);
+	t_accepted += hh;
+	return true;
+}
+
+void StepController::print() const {
+	cout << "accepted steps: " << num_accepted << endl;
+	cout << "rejected steps: " << num_rejected << endl;
+	if (num_accepted > 0) {
+		cout << "step size min/mean/max: " << h_accepted_min << " " << t_accepted / num_accepted << " " << h_accepted_max << endl;
+	}
+}
+
+StepController::~StepController()
+{
+
+}
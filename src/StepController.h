@@ -0,0 +1,45 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_STEPCONTROLLER_H_
+#define MUSCLEMASS_SRC_STEPCONTROLLER_H_
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class Joint;
+
+// Step size control for a first order integrator from a step doubling error estimate.
+// The caller takes one step of size h and two of size h / 2 from the same state; their
+// difference in the joint angles is the error. A step is accepted if the error is below
+// tol, and the next step is scaled by sqrt(tol / err).
+class StepController
+{
+public:
+	StepController(double _h, double _h_min, double _h_max, double _tol);
+	virtual ~StepController();
+
+	// Proposed step, shortened so that no joint covers more than half its distance to a limit
+	double getStepSize(const std::vector< std::shared_ptr<Joint> > &joints) const;
+	// Error of the step h just tried, returns true if it is accepted
+	bool update(double h, double err);
+	void print() const;
+
+	int getNumAccepted() const { return this->num_accepted; }
+	int getNumRejected() const { return this->num_rejected; }
+	double getMinStep() const { return this->h_accepted_min; }
+	double getMaxStep() const { return this->h_accepted_max; }
+
+private:
+	double h;				// next step
+	double h_min;
+	double h_max;
+	double tol;				// joint angle error per step
+	int num_accepted;
+	int num_rejected;
+	double h_accepted_min;
+	double h_accepted_max;
+	double t_accepted;		// time covered by the accepted steps
+};
+
+#endif // MUSCLEMASS_SRC_STEPCONTROLLER_H_
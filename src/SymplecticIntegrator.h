@@ -6,6 +6,7 @@
 
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
+#include "MLCommon.h"
 
 class Rigid;
 class Spring;
@@ -13,14 +14,26 @@ class Particle;
 class Joint;
 class Program;
 class MatrixStack;
+class ArticulatedBody;
+class SparseKKT;
+class ChainKinematicsBase;
+class JacobianOperator;
+class QuadProgBox;
+class FactorizationCache;
 
 class SymplecticIntegrator {
 public:
 	SymplecticIntegrator(std::vector< std::shared_ptr<Rigid> > _boxes, std::vector< std::shared_ptr<Joint>> _joints, std::vector< std::shared_ptr<Spring> > _springs, bool _isReduced, int _num_samples, Eigen::Vector3d _grav, double _epsilon);
 	void step(double h);
+	double stabilize();
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P) const;
 	Eigen::MatrixXd getJ_twist_thetadot();
 	Eigen::MatrixXd getGlobalJacobian(Eigen::VectorXd thetalist);
+	void setArticulated(bool _isArticulated) { this->isArticulated = _isArticulated; }
+	void setJointLimit(bool _isJointLimit) { this->isJointLimit = _isJointLimit; }
+	void setStabilization(bool _isStabilized) { this->isStabilized = _isStabilized; }
+	void setFactorizationTolerance(double tol);
+	std::shared_ptr<FactorizationCache> getFactorization() const { return this->factorization; }
 	virtual ~SymplecticIntegrator();
 
 	double m;
@@ -28,6 +41,30 @@ public:
 	const int num_joints;
 
 private:
+	void updateJ_twist_thetadot();
+
+	// Per-step buffers, sized at construction so that step() does not allocate
+	struct Workspace {
+		Eigen::VectorXd thetalist;
+		Eigen::VectorXd thetadotlist;
+		Eigen::VectorXd thetaddotlist;
+		Eigen::VectorXd newthetadotlist;
+		Eigen::VectorXd thetalistnew;
+		Eigen::VectorXd phi;		// box twists
+		Eigen::MatrixXd M_s;		// spring inertia, reduced coord
+		std::vector<Matrix12d> M_springs;	// inertia of each spring over its two boxes, maximal coord
+		Eigen::VectorXd b_s;		// spring gravity
+		Eigen::VectorXd f_e;		// spring elastic force
+		Eigen::VectorXd c_vp;		// velocity product
+		Eigen::VectorXd rhs;
+		Eigen::VectorXd xl;			// QP lower bound
+		Eigen::VectorXd xu;			// QP upper bound
+		Eigen::VectorXd c;			// QP linear term
+		Eigen::VectorXd sol;		// QP solution, the limited thetadot
+		Eigen::VectorXd b_drift;	// joint drift in the constraint rows of the KKT system
+		Eigen::VectorXd x_drift;	// box displacements that remove it
+	};
+
 	std::vector< std::shared_ptr<Rigid> > boxes;
 	std::vector < std::shared_ptr<Rigid> > moving_boxes;
 	std::vector< std::shared_ptr<Spring> > springs;
@@ -38,11 +75,18 @@ private:
 	Eigen::VectorXd x;
 	Eigen::VectorXd b;
 	Eigen::VectorXd f;
-	Eigen::VectorXd ftest;
-	Eigen::VectorXd f_b;
-	Eigen::VectorXd f_c;
+	Workspace ws;
 	double epsilon;
 	bool isReduced;
+	bool isArticulated;	// reduced coord only, recursive forward dynamics instead of the dense solve
+	std::shared_ptr<ArticulatedBody> articulated;
+	std::shared_ptr<ChainKinematicsBase> chain;	// reduced coord only, dense solve
+	std::shared_ptr<JacobianOperator> jacobian;	// reduced coord only, shared with articulated, J and J^T without forming J
+	std::shared_ptr<FactorizationCache> factorization;	// reduced coord only, LDLT of A reused across steps
+	std::shared_ptr<SparseKKT> kkt;	// maximal coord only
+	bool isStabilized;	// maximal coord only, project the poses back onto the joints after each step
+	bool isJointLimit;	// reduced coord only, clamp the joint velocities at the joint limits
+	std::shared_ptr<QuadProgBox> qp;	// kept across steps to warm start from the last active set
 	Eigen::Vector3d grav;
 	std::vector< std::shared_ptr<Particle> > debug_points;
 	int num_samples;	// The number of samples along the muscle lines
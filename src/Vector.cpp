@@ -1,15 +1,19 @@
 #include <iostream>
 
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Vector.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Particle.h"
 
@@ -43,6 +47,7 @@ void Vector::update(Matrix4d E) {
 
 void Vector::draw(shared_ptr<MatrixStack> MV, shared_ptr<MatrixStack> P, const shared_ptr<Program> prog) const
 {
+#ifndef ML_HEADLESS
 	if (p) {
 		prog->bind();
 		glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
@@ -59,4 +64,5 @@ void Vector::draw(shared_ptr<MatrixStack> MV, shared_ptr<MatrixStack> P, const s
 		MV->popMatrix();
 		prog->unbind();
 	}
+#endif
 }
@@ -23,6 +23,7 @@ public:
 	~Vector();
 	void reset();
 	void setP(std::shared_ptr<Particle> _p) { this->p = _p; }
+	std::shared_ptr<Particle> getP() const { return this->p; }
 	void draw(std::shared_ptr<MatrixStack> MV, std::shared_ptr<MatrixStack> P, const std::shared_ptr<Program> p) const;
 	void update(Eigen::Matrix4d E);
 
@@ -0,0 +1,104 @@
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(int _num_threads) :
+	num_threads(_num_threads),
+	next_queue(0),
+	num_queued(0),
+	isDone(false),
+	num_pending(0)
+{
+	if (num_threads <= 0) {
+		num_threads = max(1, (int)thread::hardware_concurrency());
+	}
+
+	for (int i = 0; i < num_threads; ++i) {
+		queues.push_back(unique_ptr<Queue>(new Queue()));
+	}
+	for (int i = 0; i < num_threads; ++i) {
+		workers.push_back(thread(&WorkStealingPool::workerLoop, this, i));
+	}
+}
+
+void WorkStealingPool::submit(function<void()> task) {
+	num_pending++;
+	int id = next_queue++ % num_threads;
+	{
+		lock_guard<mutex> lock(queues[id]->mutex);
+		queues[id]->tasks.push_back(move(task));
+	}
+	{
+		lock_guard<mutex> lock(wake_mutex);
+		num_queued++;
+	}
+	wake_cv.notify_one();
+}
+
+void WorkStealingPool::wait() {
+	unique_lock<mutex> lock(done_mutex);
+	done_cv.wait(lock, [this] { return num_pending == 0; });
+}
+
+bool WorkStealingPool::pop(int id, function<void()> &task) {
+	// Newest task first from the own queue
+	lock_guard<mutex> lock(queues[id]->mutex);
+	if (queues[id]->tasks.empty()) {
+		return false;
+	}
+	task = move(queues[id]->tasks.back());
+	queues[id]->tasks.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::steal(int id, function<void()> &task) {
+	// Oldest task first from the other queues
+	for (int k = 1; k < num_threads; ++k) {
+		int victim = (id + k) % num_threads;
+		lock_guard<mutex> lock(queues[victim]->mutex);
+		if (!queues[victim]->tasks.empty()) {
+			task = move(queues[victim]->tasks.front());
+			queues[victim]->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(int id) {
+	while (true) {
+		function<void()> task;
+		if (pop(id, task) || steal(id, task)) {
+			{
+				lock_guard<mutex> lock(wake_mutex);
+				num_queued--;
+			}
+			task();
+			if (--num_pending == 0) {
+				lock_guard<mutex> lock(done_mutex);
+				done_cv.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing to run, sleep until a task is submitted
+		unique_lock<mutex> lock(wake_mutex);
+		wake_cv.wait(lock, [this] { return isDone || num_queued > 0; });
+		if (isDone && num_queued == 0) {
+			return;
+		}
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	wait();
+	{
+		lock_guard<mutex> lock(wake_mutex);
+		isDone = true;
+	}
+	wake_cv.notify_all();
+	for (int i = 0; i < (int)workers.size(); ++i) {
+		workers[i].join();
+	}
+}
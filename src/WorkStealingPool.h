@@ -0,0 +1,51 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_WORKSTEALINGPOOL_H_
+#define MUSCLEMASS_SRC_WORKSTEALINGPOOL_H_
+#include <vector>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Fixed pool of worker threads, each with its own task queue.
+// A worker takes the newest task of its own queue and, when that is empty,
+// steals the oldest task of another queue, so long tasks do not leave cores idle.
+class WorkStealingPool
+{
+public:
+	WorkStealingPool(int _num_threads = 0);	// 0 uses all hardware threads
+	virtual ~WorkStealingPool();
+
+	void submit(std::function<void()> task);
+	void wait();	// blocks until every submitted task has finished
+	int getNumThreads() const { return this->num_threads; }
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque< std::function<void()> > tasks;
+	};
+
+	void workerLoop(int id);
+	bool pop(int id, std::function<void()> &task);
+	bool steal(int id, std::function<void()> &task);
+
+	int num_threads;
+	std::vector< std::unique_ptr<Queue> > queues;
+	std::vector<std::thread> workers;
+	std::atomic<int> next_queue;	// round robin for submitted tasks
+
+	std::mutex wake_mutex;
+	std::condition_variable wake_cv;
+	int num_queued;		// tasks waiting in the queues, guarded by wake_mutex
+	bool isDone;
+
+	std::mutex done_mutex;
+	std::condition_variable done_cv;
+	std::atomic<int> num_pending;	// tasks submitted and not finished yet
+};
+
+#endif // MUSCLEMASS_SRC_WORKSTEALINGPOOL_H_
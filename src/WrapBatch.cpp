@@ -0,0 +1,159 @@
+#include "WrapBatch.h"
+#include "WrapObst.h"
+
+using namespace std;
+using namespace Eigen;
+
+typedef WrapBatch::Points Points;
+
+// Row-wise vector operations, one obstacle per column
+
+static void cross(const Points &a, const Points &b, Points &c)
+{
+	c.row(0) = a.row(1) * b.row(2) - a.row(2) * b.row(1);
+	c.row(1) = a.row(2) * b.row(0) - a.row(0) * b.row(2);
+	c.row(2) = a.row(0) * b.row(1) - a.row(1) * b.row(0);
+}
+
+static void normalize(Points &a, WrapBatch::Values &w)
+{
+	w = (a.row(0).square() + a.row(1).square() + a.row(2).square()).rsqrt();
+	a.row(0) *= w;
+	a.row(1) *= w;
+	a.row(2) *= w;
+}
+
+static void toFrame(const Points &ex, const Points &ey, const Points &ez, const Points &d, Points &x)
+{
+	// x = M d with M = [ex ey ez]^T
+	x.row(0) = ex.row(0) * d.row(0) + ex.row(1) * d.row(1) + ex.row(2) * d.row(2);
+	x.row(1) = ey.row(0) * d.row(0) + ey.row(1) * d.row(1) + ey.row(2) * d.row(2);
+	x.row(2) = ez.row(0) * d.row(0) + ez.row(1) * d.row(1) + ez.row(2) * d.row(2);
+}
+
+static void toWorld(const Points &ex, const Points &ey, const Points &ez, const Points &x, const Points &O, Points &X)
+{
+	// X = M^T x + O
+	for (int k = 0; k < 3; ++k) {
+		X.row(k) = ex.row(k) * x.row(0) + ey.row(k) * x.row(1) + ez.row(k) * x.row(2) + O.row(k);
+	}
+}
+
+WrapBatch::WrapBatch()
+{
+
+}
+
+WrapBatch::~WrapBatch()
+{
+
+}
+
+void WrapBatch::resize(int n)
+{
+	P.resize(3, n);
+	S.resize(3, n);
+	O.resize(3, n);
+	Z.resize(3, n);
+	R.resize(n);
+	q.resize(3, n);
+	t.resize(3, n);
+	Q.resize(3, n);
+	T.resize(3, n);
+	ex.resize(3, n);
+	ey.resize(3, n);
+	ez.resize(3, n);
+	length.resize(n);
+	margin.resize(n);
+	status.resize(n);
+	dp.resize(3, n);
+	ds.resize(3, n);
+	p.resize(3, n);
+	s.resize(3, n);
+	R2.resize(n);
+	denom_q.resize(n);
+	denom_t.resize(n);
+	root_q.resize(n);
+	root_t.resize(n);
+	pq_xy.resize(n);
+	ts_xy.resize(n);
+	w.resize(n);
+}
+
+void WrapBatch::computeTangents()
+{
+	// The xy tangent points from p and s, the status and the angle between them
+	int n = size();
+	R2 = R.square();
+	denom_q = p.row(0).square() + p.row(1).square();
+	denom_t = s.row(0).square() + s.row(1).square();
+	root_q = (denom_q - R2).max(0.0).sqrt();
+	root_t = (denom_t - R2).max(0.0).sqrt();
+
+	q.row(0) = (p.row(0) * R2 + R * p.row(1) * root_q) / denom_q;
+	q.row(1) = (p.row(1) * R2 - R * p.row(0) * root_q) / denom_q;
+	t.row(0) = (s.row(0) * R2 - R * s.row(1) * root_t) / denom_t;
+	t.row(1) = (s.row(1) * R2 + R * s.row(0) * root_t) / denom_t;
+
+	// Inside the radius the single obstacle code takes the sqrt of a negative number, its
+	// no_wrap test fails on the NaN and the status stays inside_radius
+	w = q.row(0) * t.row(1) - q.row(1) * t.row(0);
+	margin = -R * w / (R2 * R.abs());
+	status = (denom_q < R2 || denom_t < R2).select(Labels::Constant(n, inside_radius),
+		(R * w > 0.0).select(Labels::Constant(n, no_wrap), Labels::Constant(n, wrap)));
+
+	length = R.abs() * (1.0 - 0.5 * ((q.row(0) - t.row(0)).square() + (q.row(1) - t.row(1)).square()) / R2).max(-1.0).min(1.0).acos();
+}
+
+void WrapBatch::computeSpheres()
+{
+	// Frame rows: ex along S - O, ez the normal of the O, P, S plane pointing to +z, ey = ez x ex
+	dp = P - O;
+	ds = S - O;
+	ex = ds;
+	normalize(ex, w);
+	cross(dp, ex, ez);
+	normalize(ez, w);
+	w = (ez.row(2) < 0.0).select(Values::Constant(size(), -1.0), Values::Constant(size(), 1.0));
+	for (int k = 0; k < 3; ++k) {
+		ez.row(k) *= w;
+	}
+	cross(ez, ex, ey);
+
+	toFrame(ex, ey, ez, dp, p);
+	toFrame(ex, ey, ez, ds, s);
+	computeTangents();
+	q.row(2).setZero();
+	t.row(2).setZero();
+	// WrapSphere::compute() scales the angle by the signed radius
+	length *= R.sign();
+
+	toWorld(ex, ey, ez, q, O, Q);
+	toWorld(ex, ey, ez, t, O, T);
+}
+
+void WrapBatch::computeCylinders()
+{
+	// Frame rows: ez along the axis, ex = ez x (P - O) normalized, ey = ez x ex
+	dp = P - O;
+	ds = S - O;
+	ez = Z;
+	normalize(ez, w);
+	cross(ez, dp, ex);
+	normalize(ex, w);
+	cross(ez, ex, ey);
+
+	toFrame(ex, ey, ez, dp, p);
+	toFrame(ex, ey, ez, ds, s);
+	computeTangents();
+
+	// Split the height change in proportion to the xy lengths of the three segments
+	pq_xy = ((p.row(0) - q.row(0)).square() + (p.row(1) - q.row(1)).square()).sqrt();
+	ts_xy = ((t.row(0) - s.row(0)).square() + (t.row(1) - s.row(1)).square()).sqrt();
+	w = (s.row(2) - p.row(2)) / (pq_xy + length + ts_xy);
+	q.row(2) = p.row(2) + w * pq_xy;
+	t.row(2) = s.row(2) - w * ts_xy;
+
+	toWorld(ex, ey, ez, q, O, Q);
+	toWorld(ex, ey, ez, t, O, T);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_WRAPBATCH_H_
+#define MUSCLEMASS_SRC_WRAPBATCH_H_
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+// Tangent points of many sphere or cylinder obstacles at once, the same results as
+// WrapSphere::compute() and WrapCylinder::compute() for each obstacle.
+// Obstacle i owns column i of every array. The 3 x n arrays are row major, so each
+// coordinate of all the obstacles is contiguous and the kernels are Eigen array
+// expressions over whole rows, which vectorize across obstacles. The branches of the
+// single obstacle code become selects, and the arc angle is a clamped real acos.
+class WrapBatch
+{
+public:
+	typedef Eigen::Array<double, 3, Eigen::Dynamic, Eigen::RowMajor> Points;
+	typedef Eigen::Array<double, 1, Eigen::Dynamic> Values;
+	typedef Eigen::Array<int, 1, Eigen::Dynamic> Labels;
+
+	WrapBatch();
+	virtual ~WrapBatch();
+	void resize(int n);
+	int size() const { return (int)this->R.size(); }
+
+	void computeSpheres();
+	void computeCylinders();
+
+	// Inputs
+	Points P;			// muscle origin
+	Points S;			// muscle insertion
+	Points O;			// obstacle center
+	Points Z;			// cylinder axis, not used by spheres
+	Values R;			// radius
+
+	// Outputs
+	Points q;			// tangent points in the obstacle frame, as point_q and point_t
+	Points t;
+	Points Q;			// tangent points in world coords
+	Points T;
+	Points ex, ey, ez;	// rows of the obstacle frame M
+	Values length;		// arc length on the obstacle
+	Values margin;		// as wrap_margin
+	Labels status;		// wrap, inside_radius or no_wrap
+
+private:
+	void computeTangents();
+
+	// Workspace, sized by resize() so that the kernels do not allocate
+	Points dp, ds;		// P - O and S - O
+	Points p, s;			// P and S in the obstacle frame
+	Values R2;
+	Values denom_q;		// squared xy distance of p from the axis
+	Values denom_t;		// and of s
+	Values root_q;
+	Values root_t;
+	Values pq_xy;			// xy length of the straight segments
+	Values ts_xy;
+	Values w;				// per obstacle scale factor
+};
+
+#endif // MUSCLEMASS_SRC_WRAPBATCH_H_
@@ -1,7 +1,9 @@
 #include <iostream>
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -9,24 +11,25 @@
 
 #include "WrapCylinder.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Rigid.h"
 #include "Particle.h"
 #include "Vector.h"
+#include "WrapBatch.h"
 
 using namespace std;
 using namespace Eigen;
 
 void WrapCylinder::compute()
 {
+	// X is normalized after the cross product and Z x X is already a unit vector
 	Eigen::Vector3d OP = this->point_P - this->point_O;
-	OP = OP / OP.norm();
-	Eigen::Vector3d vec_Z = vec_z / vec_z.norm();
-	Eigen::Vector3d vec_X = vec_Z.cross(OP);
-	vec_X = vec_X / vec_X.norm();
+	Eigen::Vector3d vec_Z = vec_z.normalized();
+	Eigen::Vector3d vec_X = vec_Z.cross(OP).normalized();
 	Eigen::Vector3d vec_Y = vec_Z.cross(vec_X);
-	vec_Y = vec_Y / vec_Y.norm();
 
 	this->M << vec_X.transpose(), vec_Y.transpose(), vec_Z.transpose();
 
@@ -54,15 +57,16 @@ void WrapCylinder::compute()
 	t(0) = (s(0) * R*R - R * s(1) * root_t) / denom_t;
 	t(1) = (s(1) * R*R + R * s(0) * root_t) / denom_t;
 
+	this->wrap_margin = -R * (q(0) * t(1) - q(1) * t(0)) / (R*R * abs(R));
 	if (R * (q(0) * t(1) - q(1) * t(0)) > 0.0)
 	{
 		this->status = no_wrap;
 	}
 
-	std::complex<double> qt_i = 1.0 - 0.5 *
+	double qt_i = 1.0 - 0.5 *
 		((q(0) - t(0)) * (q(0) - t(0))
 			+ (q(1) - t(1)) * (q(1) - t(1))) / (R*R);
-	double qt_xy = abs(R * acos(qt_i));// changed
+	double qt_xy = abs(R) * safeAcos(qt_i);
 	this->path_length = qt_xy;
 
 	double pq_xy = sqrt((p(0) - q(0)) * (p(0) - q(0)) +
@@ -77,10 +81,95 @@ void WrapCylinder::compute()
 
 	Eigen::Vector3d Q = this->M.transpose() * q + this->point_O;
 	Eigen::Vector3d T = this->M.transpose() * t + this->point_O;
+	updateTotalLength(Q, T, this->status == wrap);
 
 	// std::cout << Q.transpose() << std::endl << T.transpose() << std::endl;
 }
 
+void WrapCylinder::computeDerivatives()
+{
+	dL.resize(1, 12);
+	dQ.resize(3, 12);
+	dT.resize(3, 12);
+	if (this->status == inside_radius) {
+		dL.setZero();
+		dQ.setZero();
+		dT.setZero();
+		updateTotalLengthDerivative(Vector3d::Zero(), Vector3d::Zero(), false);
+		return;
+	}
+
+	// Turning the frame about the axis leaves the world results alone, so M is held fixed
+	// while P and S move
+	Eigen::Vector3d p = this->M * (this->point_P - this->point_O);
+	Eigen::Vector3d s = this->M * (this->point_S - this->point_O);
+	Eigen::Matrix<double, 3, 6> dq, dt;
+	Eigen::Matrix<double, 1, 6> darc;
+	computeTangentDerivatives(p, s, this->radius, abs(this->radius), false, dq, dt, darc);
+
+	Matrix3d MT = this->M.transpose();
+	dL.block<1, 3>(0, 0) = darc.leftCols<3>() * this->M;
+	dL.block<1, 3>(0, 3) = darc.rightCols<3>() * this->M;
+	dQ.block<3, 3>(0, 0) = MT * dq.leftCols<3>() * this->M;
+	dQ.block<3, 3>(0, 3) = MT * dq.rightCols<3>() * this->M;
+	dT.block<3, 3>(0, 0) = MT * dt.leftCols<3>() * this->M;
+	dT.block<3, 3>(0, 3) = MT * dt.rightCols<3>() * this->M;
+
+	Eigen::Vector3d Q = MT * this->point_q + this->point_O;
+	Eigen::Vector3d T = MT * this->point_t + this->point_O;
+	MatrixXd dO, dz;
+	computeObstacleDerivatives(point_P, point_S, point_O, vec_z, nullptr, dL.block<1, 3>(0, 0), dL.block<1, 3>(0, 3), dO, dz);
+	dL.block<1, 3>(0, 6) = dO;
+	dL.block<1, 3>(0, 9) = dz;
+	computeObstacleDerivatives(point_P, point_S, point_O, vec_z, &Q, dQ.block<3, 3>(0, 0), dQ.block<3, 3>(0, 3), dO, dz);
+	dQ.block<3, 3>(0, 6) = dO;
+	dQ.block<3, 3>(0, 9) = dz;
+	computeObstacleDerivatives(point_P, point_S, point_O, vec_z, &T, dT.block<3, 3>(0, 0), dT.block<3, 3>(0, 3), dO, dz);
+	dT.block<3, 3>(0, 6) = dO;
+	dT.block<3, 3>(0, 9) = dz;
+	updateTotalLengthDerivative(Q, T, this->status == wrap);
+}
+
+double WrapCylinder::checkDerivatives(double h)
+{
+	return WrapObst::checkDerivatives({ &point_P, &point_S, &point_O, &vec_z }, [this]() {
+		compute();
+		VectorXd f(8);
+		f << this->path_length, this->total_length, this->M.transpose() * this->point_q + this->point_O, this->M.transpose() * this->point_t + this->point_O;
+		return f;
+	}, h);
+}
+
+void WrapCylinder::computeInputJacobian(int num_joints, MatrixXd &J) const
+{
+	J.resize(12, num_joints);
+	MatrixXd Ji;
+	computePointJacobian(P, num_joints, Ji);
+	J.middleRows<3>(0) = Ji;
+	computePointJacobian(S, num_joints, Ji);
+	J.middleRows<3>(3) = Ji;
+	computePointJacobian(O, num_joints, Ji);
+	J.middleRows<3>(6) = Ji;
+	computeDirectionJacobian(Z, num_joints, Ji);
+	J.middleRows<3>(9) = Ji;
+}
+
+VectorXd WrapCylinder::computeMomentArms(int num_joints) const
+{
+	VectorXd arms;
+	if (getTableMomentArms(num_joints, arms)) {
+		return arms;
+	}
+	MatrixXd J;
+	computeInputJacobian(num_joints, J);
+	return -(dTotal * J).transpose();
+}
+
+vector<int> WrapCylinder::getJointIds() const
+{
+	return computeJointIds({ P, S, O });
+}
+
 MatrixXd WrapCylinder::getPoints(int num_points, double &theta_s, double &theta_e, Matrix3d &_M)const
 {
 	double theta_q = atan(this->point_q(1) / this->point_q(0));
@@ -138,19 +227,49 @@ void WrapCylinder::reset() {
 }
 
 void WrapCylinder::step() {
+	// The inputs stay current under a table as well, for drawing
 	point_P = P->x;
 	point_O = O->x;
 	point_S = S->x;
 	vec_z = Z->dir;
+	if (stepTable() || stepBatch()) {
+		return;
+	}
 	compute();
-	double theta_s, theta_e;
-	Matrix3d M;
-	if (this->status == wrap) {
-		this->arc_points = getPoints(num_points, theta_s, theta_e, M);
+	++version;
+	if (isDerivatives || isCheckDerivatives) {
+		computeDerivatives();
+	}
+	if (isCheckDerivatives) {
+		cout << "Wrap derivative error: " << checkDerivatives(1e-6) << endl;
 	}
 }
 
+void WrapCylinder::getBatchInputs(WrapBatch &batch, int i) const
+{
+	batch.P.col(i) = point_P.array();
+	batch.S.col(i) = point_S.array();
+	batch.O.col(i) = point_O.array();
+	batch.Z.col(i) = vec_z.array();
+	batch.R(i) = this->radius;
+}
+
+const MatrixXd &WrapCylinder::getArcPoints() const
+{
+	if (isTabulated || this->status != wrap) {
+		arc_points.resize(3, 0);
+	}
+	else if (arc_version != version) {
+		double theta_s, theta_e;
+		Matrix3d M;
+		arc_points = getPoints(num_points, theta_s, theta_e, M);
+		arc_version = version;
+	}
+	return arc_points;
+}
+
 void WrapCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> prog2, shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 
 	prog->bind();
 	// Draw cylinder
@@ -203,11 +322,10 @@ void WrapCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> pr
 	glBegin(GL_LINE_STRIP);
 	glVertex3f(this->point_S(0), this->point_S(1), this->point_S(2));
 
-	if (this->status == wrap) {	
-		for (int i = 0; i < this->arc_points.cols(); i++) {
-			Vector3f p = this->arc_points.block<3, 1>(0, i).cast<float>();
-			glVertex3f(p(0), p(1), p(2));
-		}
+	const MatrixXd &arc = getArcPoints();
+	for (int i = 0; i < arc.cols(); i++) {
+		Vector3f p = arc.block<3, 1>(0, i).cast<float>();
+		glVertex3f(p(0), p(1), p(2));
 	}
 
 	glVertex3f(this->point_P(0), this->point_P(1), this->point_P(2));
@@ -219,4 +337,5 @@ void WrapCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> pr
 	MV->popMatrix();
 	prog2->unbind();
 
+#endif
 }
\ No newline at end of file
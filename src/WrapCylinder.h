@@ -31,7 +31,8 @@ private:
 	Eigen::Vector3d vec_z;      // Cylinder Positive z axis
 	Eigen::Matrix4d E_W_0;		// Where current transform is wrt world(updated)
 	Eigen::Matrix4d E_P_0;		// Where the local frame is wrt parent(fixed)
-	Eigen::MatrixXd arc_points; // each col stores the position of a point in that arc
+	mutable Eigen::MatrixXd arc_points; // each col stores the position of a point in that arc
+	mutable int arc_version;	// version the arc points belong to
 
 	std::shared_ptr<Rigid> parent;
 	std::shared_ptr<Particle> P;
@@ -47,6 +48,7 @@ public:
 	{
 		vec_z = Eigen::Vector3d(0.0, 0.0, 0.0);
 		type = cylinder;
+		arc_version = -1;
 	}
 
 	void setCylinderConfig(const Eigen::Vector3d &O,
@@ -73,7 +75,7 @@ public:
 		this->type = cylinder;
 		this->r = _r;
 		this->radius = this->r;
-		this->arc_points.resize(3, this->num_points + 1);
+		this->arc_version = -1;
 	}
 
 	using WrapObst::compute;
@@ -81,6 +83,22 @@ public:
 
 	using WrapObst::getPoints;
 	Eigen::MatrixXd getPoints(int num_points, double &theta_s, double &theta_e, Eigen::Matrix3d &_M) const;
+	// The points along the wrapped path of the last step, computed the first time they are
+	// asked for. Empty when unwrapped or served from a table.
+	const Eigen::MatrixXd &getArcPoints() const;
+	// The inputs of the last step() into column i of a batch, see WrapObst::setBatchResults()
+	void getBatchInputs(WrapBatch &batch, int i) const;
+
+	// Derivatives wrt the inputs P, S, O, Z, see WrapObst
+	void computeDerivatives();
+	double checkDerivatives(double h);
+
+	// Jacobian of the inputs wrt the joint angles, 3 rows per input
+	void computeInputJacobian(int num_joints, Eigen::MatrixXd &J) const;
+	// -d total_length / dtheta, the moment arms of the path from P to S about each joint
+	Eigen::VectorXd computeMomentArms(int num_joints) const;
+	// Joints the inputs depend on, the angles of a WrapTable for this obstacle
+	std::vector<int> getJointIds() const;
 
 	void reset();
 	void step();
@@ -1,7 +1,9 @@
 #include <iostream>
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -9,40 +11,35 @@
 
 #include "WrapDoubleCylinder.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Rigid.h"
 #include "Particle.h"
 #include "Vector.h"
+#include "WrapTable.h"
 
 using namespace std;
 using namespace Eigen;
 
 void WrapDoubleCylinder::compute()
 {
-	// compute Matrix U and V
+	// compute Matrix U and V, X is normalized after the cross product and Z x X is already a unit vector
 	Eigen::Vector3d OP = this->point_P - this->point_U;
-	OP = OP / OP.norm();
-	Eigen::Vector3d vec_Z_U = vec_z_U / vec_z_U.norm();
-	Eigen::Vector3d vec_X_U = vec_Z_U.cross(OP);
-	vec_X_U = vec_X_U / vec_X_U.norm();
+	Eigen::Vector3d vec_Z_U = vec_z_U.normalized();
+	Eigen::Vector3d vec_X_U = vec_Z_U.cross(OP).normalized();
 	Eigen::Vector3d vec_Y_U = vec_Z_U.cross(vec_X_U);
-	vec_Y_U = vec_Y_U / vec_Y_U.norm();
 
 	Eigen::Vector3d OS = this->point_S - this->point_V;
-	OS = OS / OS.norm();
-	Eigen::Vector3d vec_Z_V = vec_z_V / vec_z_V.norm();
-	Eigen::Vector3d vec_X_V = vec_Z_V.cross(OS);
-	vec_X_V = vec_X_V / vec_X_V.norm();
+	Eigen::Vector3d vec_Z_V = vec_z_V.normalized();
+	Eigen::Vector3d vec_X_V = vec_Z_V.cross(OS).normalized();
 	Eigen::Vector3d vec_Y_V = vec_Z_V.cross(vec_X_V);
-	vec_Y_V = vec_Y_V / vec_Y_V.norm();
 
-	this->M_U.resize(3, 3);
 	this->M_U.row(0) = vec_X_U.transpose();
 	this->M_U.row(1) = vec_Y_U.transpose();
 	this->M_U.row(2) = vec_Z_U.transpose();
 
-	this->M_V.resize(3, 3);
 	this->M_V.row(0) = vec_X_V.transpose();
 	this->M_V.row(1) = vec_Y_V.transpose();
 	this->M_V.row(2) = vec_Z_V.transpose();
@@ -75,27 +72,29 @@ void WrapDoubleCylinder::compute()
 		status_V = wrap;
 	}
 
-	this->status = wrap;
-
-	std::complex<double> ht_i = 1.0 - 0.5 *
+	double ht_i = 1.0 - 0.5 *
 		((h(0) - t(0)) * (h(0) - t(0))
 			+ (h(1) - t(1)) * (h(1) - t(1))) / (Rv*Rv);
-	std::complex<double> ph_i = 1.0 - 0.5 *
+	double ph_i = 1.0 - 0.5 *
 		((pv(0) - h(0)) * (pv(0) - h(0))
 			+ (pv(1) - h(1)) * (pv(1) - h(1))) / (Rv*Rv);
-	std::complex<double> ts_i = 1.0 - 0.5 *
+	double ts_i = 1.0 - 0.5 *
 		((t(0) - sv(0)) * (t(0) - sv(0))
 			+ (t(1) - sv(1)) * (t(1) - sv(1))) / (Rv*Rv);
 
-	double ht_xy = abs(Rv * acos(ht_i));
-	double ph_xy = abs(Rv * acos(ph_i));
-	double ts_xy = abs(Rv * acos(ts_i));
+	double ht_xy = abs(Rv) * safeAcos(ht_i);
+	double ph_xy = abs(Rv) * safeAcos(ph_i);
+	double ts_xy = abs(Rv) * safeAcos(ts_i);
 
 	h(2) = pv(2) + (sv(2) - pv(2)) * ph_xy / (ph_xy + ht_xy + ts_xy);
 	t(2) = sv(2) - (sv(2) - pv(2)) * ts_xy / (ph_xy + ht_xy + ts_xy);
 
 	Eigen::Vector3d H = this->M_V.transpose() * h + this->point_V;
 	Eigen::Vector3d T = this->M_V.transpose() * t + this->point_V;
+	if (isWarmStart && isWarm) {
+		// The tangent points barely move between frames, start from the last H
+		H = this->E_W_V.block<3, 3>(0, 0) * this->h_warm + this->E_W_V.block<3, 1>(0, 3);
+	}
 	Eigen::Vector3d H0 = H;
 
 	Eigen::Vector3d q(0.0, 0.0, 0.0);
@@ -105,8 +104,13 @@ void WrapDoubleCylinder::compute()
 	double len = 0.0;
 	Eigen::Vector3d pu = this->M_U * (this->point_P - this->point_U);
 
-	for (int i = 0; i < 30; i++)
+	// Alternate between the two cylinders until H settles. A cylinder the path passes by
+	// puts both its tangent points on P or S, so its arc is empty.
+	Eigen::Vector3d t_S = t;
+	num_iters = 0;
+	for (int i = 0; i < max_iters; i++)
 	{
+		num_iters++;
 		len = 0.0;
 
 		// step 2: compute Q and G
@@ -124,33 +128,34 @@ void WrapDoubleCylinder::compute()
 		g(0) = (hu(0) * Ru*Ru - Ru * hu(1) * root_g) / denom_g;
 		g(1) = (hu(1) * Ru*Ru + Ru * hu(0) * root_g) / denom_g;
 
+		margin_U = -Ru * (q(0) * g(1) - q(1) * g(0)) / (Ru*Ru * abs(Ru));
 		if (Ru * (q(0) * g(1) - q(1) * g(0)) > 0.0)
-		 {
+		{
 			status_U = no_wrap;
-			g(0) = pu(0);
-			g(1) = pu(1);
+			q = pu;
+			g = pu;
 		}
 		else {
 			status_U = wrap;
-		}
-
-		std::complex<double> qg_i = 1.0 - 0.5 *
-			((q(0) - g(0)) * (q(0) - g(0))
-				+ (q(1) - g(1)) * (q(1) - g(1))) / (Ru*Ru);
-		std::complex<double> pq_i = 1.0 - 0.5 *
-			((pu(0) - q(0)) * (pu(0) - q(0))
-				+ (pu(1) - q(1)) * (pu(1) - q(1))) / (Ru*Ru);
-		std::complex<double> gh_i = 1.0 - 0.5 *
-			((g(0) - hu(0)) * (g(0) - hu(0))
-				+ (g(1) - hu(1)) * (g(1) - hu(1))) / (Ru*Ru);
 
-		double qg_xy = abs(Rv * acos(qg_i));
-		double pq_xy = abs(Rv * acos(pq_i));
-		double gh_xy = abs(Rv * acos(gh_i));
-		len += qg_xy;
-
-		q(2) = pu(2) + (hu(2) - pu(2)) * pq_xy / (pq_xy + qg_xy + gh_xy);
-		g(2) = hu(2) - (hu(2) - pu(2)) * gh_xy / (pq_xy + qg_xy + gh_xy);
+			double qg_i = 1.0 - 0.5 *
+				((q(0) - g(0)) * (q(0) - g(0))
+					+ (q(1) - g(1)) * (q(1) - g(1))) / (Ru*Ru);
+			double pq_i = 1.0 - 0.5 *
+				((pu(0) - q(0)) * (pu(0) - q(0))
+					+ (pu(1) - q(1)) * (pu(1) - q(1))) / (Ru*Ru);
+			double gh_i = 1.0 - 0.5 *
+				((g(0) - hu(0)) * (g(0) - hu(0))
+					+ (g(1) - hu(1)) * (g(1) - hu(1))) / (Ru*Ru);
+
+			double qg_xy = abs(Rv) * safeAcos(qg_i);
+			double pq_xy = abs(Rv) * safeAcos(pq_i);
+			double gh_xy = abs(Rv) * safeAcos(gh_i);
+			len += qg_xy;
+
+			q(2) = pu(2) + (hu(2) - pu(2)) * pq_xy / (pq_xy + qg_xy + gh_xy);
+			g(2) = hu(2) - (hu(2) - pu(2)) * gh_xy / (pq_xy + qg_xy + gh_xy);
+		}
 
 		Q = this->M_U.transpose() * q + this->point_U;
 		G = this->M_U.transpose() * g + this->point_U;
@@ -164,33 +169,35 @@ void WrapDoubleCylinder::compute()
 		h = Eigen::Vector3d(0.0, 0.0, 0.0);
 		h(0) = (gv(0) * Rv*Rv + Rv * gv(1) * root_h) / denom_h;
 		h(1) = (gv(1) * Rv*Rv - Rv * gv(0) * root_h) / denom_h;
+		t = t_S;
 
-		std::complex<double> ht_i = 1.0 - 0.5 *
-			((h(0) - t(0)) * (h(0) - t(0))
-				+ (h(1) - t(1)) * (h(1) - t(1))) / (Rv*Rv);
-		gh_i = 1.0 - 0.5 *
-			((gv(0) - h(0)) * (gv(0) - h(0))
-				+ (gv(1) - h(1)) * (gv(1) - h(1))) / (Rv*Rv);
-		std::complex<double> ts_i = 1.0 - 0.5 *
-			((t(0) - sv(0)) * (t(0) - sv(0))
-				+ (t(1) - sv(1)) * (t(1) - sv(1))) / (Rv*Rv);
-
-		double ht_xy = abs(Rv * acos(ht_i));
-		gh_xy = abs(Rv * acos(gh_i));
-		double ts_xy = abs(Rv * acos(ts_i));
-		len += ht_xy;
-
-		h(2) = gv(2) + (sv(2) - gv(2)) * gh_xy / (gh_xy + ht_xy + ts_xy);
-		t(2) = sv(2) - (sv(2) - gv(2)) * ts_xy / (gh_xy + ht_xy + ts_xy);
-
+		margin_V = -Rv * (h(0) * t(1) - h(1) * t(0)) / (Rv*Rv * abs(Rv));
 		if (Rv * (h(0) * t(1) - h(1) * t(0)) > 0.0)
 		{
 			status_V = no_wrap;
-			h(0) = sv(0);
-			h(1) = sv(1);
+			h = sv;
+			t = sv;
 		}
 		else {
 			status_V = wrap;
+
+			double ht_i = 1.0 - 0.5 *
+				((h(0) - t(0)) * (h(0) - t(0))
+					+ (h(1) - t(1)) * (h(1) - t(1))) / (Rv*Rv);
+			double gh_i = 1.0 - 0.5 *
+				((gv(0) - h(0)) * (gv(0) - h(0))
+					+ (gv(1) - h(1)) * (gv(1) - h(1))) / (Rv*Rv);
+			double ts_i = 1.0 - 0.5 *
+				((t(0) - sv(0)) * (t(0) - sv(0))
+					+ (t(1) - sv(1)) * (t(1) - sv(1))) / (Rv*Rv);
+
+			double ht_xy = abs(Rv) * safeAcos(ht_i);
+			double gh_xy = abs(Rv) * safeAcos(gh_i);
+			double ts_xy = abs(Rv) * safeAcos(ts_i);
+			len += ht_xy;
+
+			h(2) = gv(2) + (sv(2) - gv(2)) * gh_xy / (gh_xy + ht_xy + ts_xy);
+			t(2) = sv(2) - (sv(2) - gv(2)) * ts_xy / (gh_xy + ht_xy + ts_xy);
 		}
 
 		H = this->M_V.transpose() * h + this->point_V;
@@ -199,42 +206,195 @@ void WrapDoubleCylinder::compute()
 		len += (G - H).norm();
 
 		double dist = (H - H0).norm();
-		if (dist == 0) break;
+		if (dist <= tol * Rv) break;
 
 		H0 = H;
 	}
 
-	if (status_V == no_wrap)
-	{
-		t = sv;
-		T = this->M_V.transpose() * t + this->point_V;
-	}
-	else
-	{
-		status_V = wrap;
-	}
-	
-	if (status_U == no_wrap)
-	{
-		q = pu;
-		Q = this->M_U.transpose() * q + this->point_U;
-	}
-	else{
-		status_U = wrap;
-	}
+	this->wrap_margin = max(margin_U, margin_V);
+	this->status = (status_U == wrap || status_V == wrap) ? wrap : no_wrap;
+
+	// Only a wrapped H is a good guess for the next frame
+	this->isWarm = (status_V == wrap);
+	this->h_warm = this->E_W_V.block<3, 3>(0, 0).transpose() * (H - this->E_W_V.block<3, 1>(0, 3));
 
 	this->path_length = len;
 	this->point_q = q;
 	this->point_g = g;
 	this->point_h = h;
 	this->point_t = t;
+	// The sides of a cylinder the path passes by are already on P or S
+	updateTotalLength(Q, T, true);
 	/*
 	std::cout << Q.transpose() << std::endl << G.transpose() << std::endl
 	<< H.transpose() << std::endl << T.transpose() << std::endl;
 	*/
 }
 
-Eigen::MatrixXd WrapDoubleCylinder::getPoints(int num_points)
+MatrixXd WrapDoubleCylinder::computeStepDerivatives(const Matrix3d &M, const MatrixXd &d,
+	const Vector3d &A, const Vector3d &B, const Vector3d &O, const Vector3d &z, const Vector3d *X)
+{
+	MatrixXd dA = d.leftCols(3) * M;
+	MatrixXd dB = d.rightCols(3) * M;
+	if (X) {
+		dA = M.transpose() * dA;
+		dB = M.transpose() * dB;
+	}
+	MatrixXd dO, dz;
+	computeObstacleDerivatives(A, B, O, z, X, dA, dB, dO, dz);
+	MatrixXd D(d.rows(), 12);
+	D << dA, dB, dO, dz;
+	return D;
+}
+
+void WrapDoubleCylinder::computeDerivatives()
+{
+	dL.setZero(1, 18);
+	dQ.setZero(3, 18);
+	dT.setZero(3, 18);
+	dG.setZero(3, 18);
+	dH.setZero(3, 18);
+
+	Matrix3d MUT = this->M_U.transpose();
+	Matrix3d MVT = this->M_V.transpose();
+	Vector3d Q = MUT * this->point_q + this->point_U;
+	Vector3d G = MUT * this->point_g + this->point_U;
+	Vector3d H = MVT * this->point_h + this->point_V;
+	Vector3d T = MVT * this->point_t + this->point_V;
+
+	// Step 2 takes P and H to Q, G and the arc on U, step 3 takes G and S to H, T and the
+	// arc on V. Each is a cylinder wrap with arcs as sides, as in compute(). A cylinder the
+	// path passes by has no step, its tangent points are P or S.
+	Eigen::Matrix<double, 3, 6> dq, dg, dh, dt;
+	Eigen::Matrix<double, 1, 6> dqg, dht;
+	double k = abs(this->radius_V);
+	MatrixXd DQ, DG, Dqg, DH, DT, Dht;
+	if (status_U == wrap) {
+		computeTangentDerivatives(this->M_U * (this->point_P - this->point_U), this->M_U * (H - this->point_U),
+			-this->radius_U, k, true, dq, dg, dqg);
+		DQ = computeStepDerivatives(M_U, dq, point_P, H, point_U, vec_z_U, &Q);
+		DG = computeStepDerivatives(M_U, dg, point_P, H, point_U, vec_z_U, &G);
+		Dqg = computeStepDerivatives(M_U, dqg, point_P, H, point_U, vec_z_U, nullptr);
+	}
+	if (status_V == wrap) {
+		computeTangentDerivatives(this->M_V * (G - this->point_V), this->M_V * (this->point_S - this->point_V),
+			this->radius_V, k, true, dh, dt, dht);
+		DH = computeStepDerivatives(M_V, dh, G, point_S, point_V, vec_z_V, &H);
+		DT = computeStepDerivatives(M_V, dt, G, point_S, point_V, vec_z_V, &T);
+		Dht = computeStepDerivatives(M_V, dht, G, point_S, point_V, vec_z_V, nullptr);
+	}
+
+	// Spread the step columns over the inputs P, S, U, Z_U, V, Z_V, leaving out H and G
+	auto inputsU = [](const MatrixXd &D) {
+		MatrixXd D_in = MatrixXd::Zero(D.rows(), 18);
+		D_in.middleCols(0, 3) = D.middleCols(0, 3);
+		D_in.middleCols(6, 6) = D.middleCols(6, 6);
+		return D_in;
+	};
+	auto inputsV = [](const MatrixXd &D) {
+		MatrixXd D_in = MatrixXd::Zero(D.rows(), 18);
+		D_in.middleCols(3, 3) = D.middleCols(3, 3);
+		D_in.middleCols(12, 6) = D.middleCols(6, 6);
+		return D_in;
+	};
+	MatrixXd dP = MatrixXd::Zero(3, 18);
+	MatrixXd dS = MatrixXd::Zero(3, 18);
+	dP.middleCols(0, 3).setIdentity();
+	dS.middleCols(3, 3).setIdentity();
+
+	if (status_U == wrap && status_V == wrap) {
+		// H is a fixed point of H -> step3(step2(H)), so by the implicit function theorem
+		// (I - H_G G_H) dH = H_G dG_in + dH_in. The iteration converges, so the matrix is invertible.
+		Matrix3d G_H = DG.middleCols(3, 3);
+		Matrix3d H_G = DH.middleCols(0, 3);
+		MatrixXd DG_in = inputsU(DG);
+		dH = (Matrix3d::Identity() - H_G * G_H).lu().solve(H_G * DG_in + inputsV(DH));
+		dG = G_H * dH + DG_in;
+		dQ = DQ.middleCols(3, 3) * dH + inputsU(DQ);
+		dT = DT.middleCols(0, 3) * dG + inputsV(DT);
+		dL = Dqg.middleCols(3, 3) * dH + inputsU(Dqg) + Dht.middleCols(0, 3) * dG + inputsV(Dht);
+	}
+	else if (status_U == wrap) {
+		// H and T are S, step 2 wraps U from P to S
+		dH = dS;
+		dT = dS;
+		dG = DG.middleCols(3, 3) * dH + inputsU(DG);
+		dQ = DQ.middleCols(3, 3) * dH + inputsU(DQ);
+		dL = Dqg.middleCols(3, 3) * dH + inputsU(Dqg);
+	}
+	else if (status_V == wrap) {
+		// Q and G are P, step 3 wraps V from P to S
+		dQ = dP;
+		dG = dP;
+		dH = DH.middleCols(0, 3) * dG + inputsV(DH);
+		dT = DT.middleCols(0, 3) * dG + inputsV(DT);
+		dL = Dht.middleCols(0, 3) * dG + inputsV(Dht);
+	}
+	else {
+		dQ = dP;
+		dG = dP;
+		dH = dS;
+		dT = dS;
+	}
+
+	// path_length is the two arcs and the straight span from G to H
+	double span = (G - H).norm();
+	if (span > 0.0) {
+		dL += (G - H).transpose() / span * (dG - dH);
+	}
+	updateTotalLengthDerivative(Q, T, true);
+}
+
+double WrapDoubleCylinder::checkDerivatives(double h)
+{
+	// Iterate to full convergence, or the differences see the tolerance instead of the slope
+	double tol0 = this->tol;
+	this->tol = 0.0;
+	double err = WrapObst::checkDerivatives({ &point_P, &point_S, &point_U, &vec_z_U, &point_V, &vec_z_V }, [this]() {
+		compute();
+		VectorXd f(8);
+		f << this->path_length, this->total_length, this->M_U.transpose() * this->point_q + this->point_U, this->M_V.transpose() * this->point_t + this->point_V;
+		return f;
+	}, h);
+	this->tol = tol0;
+	return err;
+}
+
+void WrapDoubleCylinder::computeInputJacobian(int num_joints, MatrixXd &J) const
+{
+	J.resize(18, num_joints);
+	MatrixXd Ji;
+	computePointJacobian(P, num_joints, Ji);
+	J.middleRows<3>(0) = Ji;
+	computePointJacobian(S, num_joints, Ji);
+	J.middleRows<3>(3) = Ji;
+	computePointJacobian(U, num_joints, Ji);
+	J.middleRows<3>(6) = Ji;
+	computeDirectionJacobian(z_U, num_joints, Ji);
+	J.middleRows<3>(9) = Ji;
+	computePointJacobian(V, num_joints, Ji);
+	J.middleRows<3>(12) = Ji;
+	computeDirectionJacobian(z_V, num_joints, Ji);
+	J.middleRows<3>(15) = Ji;
+}
+
+VectorXd WrapDoubleCylinder::computeMomentArms(int num_joints) const
+{
+	VectorXd arms;
+	if (getTableMomentArms(num_joints, arms)) {
+		return arms;
+	}
+	MatrixXd J;
+	computeInputJacobian(num_joints, J);
+	return -(dTotal * J).transpose();
+}
+
+vector<int> WrapDoubleCylinder::getJointIds() const
+{
+	return computeJointIds({ P, S, U, V });
+}
+
+Eigen::MatrixXd WrapDoubleCylinder::getPoints(int num_points) const
 {
 	int col = 0;
 	
@@ -370,30 +530,49 @@ Eigen::MatrixXd WrapDoubleCylinder::getPoints(int num_points)
 }
 
 void WrapDoubleCylinder::step() {
+	// The inputs stay current under a table as well, for drawing
 	point_P = P->x;
 	point_U = U->x;
 	point_V = V->x;
 	point_S = S->x;
 	vec_z_U = z_U->dir;
 	vec_z_V = z_V->dir;
+	bool wasTabulated = isTabulated;
+	if (stepTable()) {
+		margin_U = table->getWrapMargin(0);
+		margin_V = table->getWrapMargin(1);
+		status_U = table->isWrapped(0) ? wrap : no_wrap;
+		status_V = table->isWrapped(1) ? wrap : no_wrap;
+		return;
+	}
+	// Leaving the range of the table, the last solve is too old to warm start from
+	if (wasTabulated) {
+		resetWarmStart();
+	}
 	compute();
+	++version;
+	if (isDerivatives || isCheckDerivatives) {
+		computeDerivatives();
+	}
+	if (isCheckDerivatives) {
+		cout << "Wrap derivative error: " << checkDerivatives(1e-6) << endl;
+	}
+}
 
-	if (status_U == wrap && status_V == wrap) {
-		arc_points.resize(3, 3 * num_points + 1);
-	}	
-	else if (status_U == wrap || status_V == wrap) {
-		arc_points.resize(3, 2 * num_points + 1);
-	}	
-	else {
-		arc_points.resize(3, 1 * num_points + 1);
-	}	
-
-	if (this->get_status_u() == wrap || this->get_status_v() == wrap) {
-		this->arc_points = getPoints(this->num_points);
+const MatrixXd &WrapDoubleCylinder::getArcPoints() const
+{
+	if (isTabulated || (status_U != wrap && status_V != wrap)) {
+		arc_points.resize(3, 0);
 	}
+	else if (arc_version != version) {
+		arc_points = getPoints(num_points);
+		arc_version = version;
+	}
+	return arc_points;
 }
 
 void WrapDoubleCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> prog2, shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 	// Draw double cylinder
 	prog->bind();
 
@@ -465,11 +644,10 @@ void WrapDoubleCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Progr
 	glBegin(GL_LINE_STRIP);
 	glVertex3f(this->point_P(0), this->point_P(1), this->point_P(2));
 	
-	if (this->get_status_u() == wrap || this->get_status_v() == wrap) {
-		for (int i = 0; i < this->arc_points.cols(); i++) {
-			Vector3f p = this->arc_points.block<3, 1>(0, i).cast<float>();
-			glVertex3f(p(0), p(1), p(2));
-		}
+	const MatrixXd &arc = getArcPoints();
+	for (int i = 0; i < arc.cols(); i++) {
+		Vector3f p = arc.block<3, 1>(0, i).cast<float>();
+		glVertex3f(p(0), p(1), p(2));
 	}
 
 	glVertex3f(this->point_S(0), this->point_S(1), this->point_S(2));
@@ -481,5 +659,6 @@ void WrapDoubleCylinder::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Progr
 
 	MV->popMatrix();
 	prog2->unbind();
+#endif
 }
 
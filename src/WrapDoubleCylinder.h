@@ -37,10 +37,14 @@ private:
 		point_g,
 		point_h;
 
-	Eigen::MatrixXd
+	Eigen::Matrix3d
 		M_U,          // Obstacle Coord Transformation Matrix for U
 		M_V;          // Obstacle Coord Transformation Matrix for V
 
+	Eigen::MatrixXd
+		dG,           // Jacobians of the world tangent points G and H, as dQ and dT
+		dH;
+
 	double
 		radius_U,     // U Cylinder Radius
 		radius_V;     // V Cylinder Radius
@@ -49,6 +53,10 @@ private:
 		status_U,     // U Wrapping Status
 		status_V;     // V Wrapping Status
 
+	double
+		margin_U,     // U and V wrap margins, as wrap_margin
+		margin_V;
+
 	std::shared_ptr<Particle> U;	// U Cylinder Origin
 	Eigen::Matrix4d E_W_U;			// Where current transform is wrt world(updated)
 	Eigen::Matrix4d E_P_U;			// Where the local frame is wrt parent(fixed)
@@ -66,17 +74,39 @@ private:
 	std::shared_ptr<Particle> P;
 	std::shared_ptr<Particle> S;
 
-	Eigen::MatrixXd arc_points;	// each col stores the position of a point in that arc
+	mutable Eigen::MatrixXd arc_points;	// each col stores the position of a point in that arc
+	mutable int arc_version;	// version the arc points belong to
 	const std::shared_ptr<Shape> cylinder_shape;
 	int num_points;
 
+	double tol;			// H moves less than tol * radius_V in an iteration when converged
+	int max_iters;
+	int num_iters;		// iterations of the last compute()
+	bool isWarmStart;	// start from the last H instead of the tangent from P
+	bool isWarm;		// h_warm holds the result of a previous compute()
+	Eigen::Vector3d h_warm;	// last H in the frame of cylinder V, which moves with its body
+
+	// World derivatives of a point X (or an arc, X null) computed by one cylinder step in the
+	// frame M, from d its derivatives in that frame wrt [A; B]. Columns are A, B, O, z.
+	static Eigen::MatrixXd computeStepDerivatives(const Eigen::Matrix3d &M, const Eigen::MatrixXd &d,
+		const Eigen::Vector3d &A, const Eigen::Vector3d &B, const Eigen::Vector3d &O, const Eigen::Vector3d &z,
+		const Eigen::Vector3d *X);
+
 public:
 	// default constructor
 	WrapDoubleCylinder()
 	{
-		vec_z_U = point_U = vec_z_V = point_V = point_g = point_h =
+		vec_z_U = point_U = vec_z_V = point_V = point_g = point_h = h_warm =
 			Eigen::Vector3d(0.0, 0.0, 0.0);
 		type = double_cylinder;
+		status_U = status_V = empty;
+		margin_U = margin_V = 0.0;
+		tol = 1e-8;
+		max_iters = 30;
+		num_iters = 0;
+		isWarmStart = false;
+		isWarm = false;
+		arc_version = -1;
 	}
 
 	void setCylinderConfig(const Eigen::Vector3d &U,
@@ -96,20 +126,43 @@ public:
 		const double R_V,
 		const int _num_points)
 		: WrapObst(),
-		radius_U(R_U), radius_V(R_V), cylinder_shape(s), num_points(_num_points)
+		radius_U(R_U), radius_V(R_V), status_U(empty), status_V(empty), margin_U(0.0), margin_V(0.0), cylinder_shape(s), num_points(_num_points),
+		tol(1e-8), max_iters(30), num_iters(0), isWarmStart(false), isWarm(false)
 	{
 		type = double_cylinder;	
-		this->arc_points.resize(3, 3 * this->num_points + 1);
+		this->h_warm.setZero();
+		this->arc_version = -1;
 	}
 
 	using WrapObst::compute;
 	void compute();
 
 	using WrapObst::getPoints;
-	Eigen::MatrixXd getPoints(int num_points);
-
-	Status get_status_u() const { return status_U; }	
+	Eigen::MatrixXd getPoints(int num_points) const;
+	// The points along the wrapped path of the last step, computed the first time they are
+	// asked for. Empty when unwrapped or served from a table.
+	const Eigen::MatrixXd &getArcPoints() const;
+
+	// Derivatives wrt the inputs P, S, U, Z_U, V, Z_V, see WrapObst, for the converged path.
+	// A cylinder the path passes by holds its two tangent points on P or S.
+	void computeDerivatives();
+	double checkDerivatives(double h);
+
+	// Jacobian of the inputs wrt the joint angles, 3 rows per input
+	void computeInputJacobian(int num_joints, Eigen::MatrixXd &J) const;
+	// -d total_length / dtheta, the moment arms of the path from P to S about each joint
+	Eigen::VectorXd computeMomentArms(int num_joints) const;
+	// Joints the inputs depend on, the angles of a WrapTable for this obstacle
+	std::vector<int> getJointIds() const;
+
+	// Also served by a table, from its U and V margins
+	Status get_status_u() const { return status_U; }
 	Status get_status_v() const { return status_V; }
+	double get_margin_u() const { return margin_U; }
+	double get_margin_v() const { return margin_V; }
+	int getNumIterations() const { return num_iters; }
+	const Eigen::MatrixXd &getGDerivative() const { return dG; }
+	const Eigen::MatrixXd &getHDerivative() const { return dH; }
 
 	void step();
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
@@ -142,6 +195,10 @@ public:
 	void setZ_U(std::shared_ptr<Vector> _z_U) { this->z_U = _z_U; this->vec_z_U = this->z_U->dir; }
 	void setZ_V(std::shared_ptr<Vector> _z_V) { this->z_V = _z_V; this->vec_z_V = this->z_V->dir; }
 	void setNumPoints(int _num_points) { this->num_points = _num_points; }
+	void setTolerance(double _tol) { this->tol = _tol; }
+	void setMaxIterations(int _max_iters) { this->max_iters = _max_iters; }
+	void setWarmStart(bool _isWarmStart) { this->isWarmStart = _isWarmStart; this->isWarm = false; }
+	void resetWarmStart() { this->isWarm = false; }
 
 	void setParent_U(std::shared_ptr<Rigid> _parent_U) { this->parent_U = _parent_U; }
 	void setParent_V(std::shared_ptr<Rigid> _parent_V) { this->parent_V = _parent_V; }
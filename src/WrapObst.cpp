@@ -0,0 +1,231 @@
+#include "WrapObst.h"
+#include "Rigid.h"
+#include "Particle.h"
+#include "Vector.h"
+#include "WrapTable.h"
+#include "WrapBatch.h"
+
+using namespace std;
+using namespace Eigen;
+
+// Tangent point of the line from a on the circle of radius R, the q side for sigma = 1 and
+// the t side for sigma = -1, and its Jacobian D wrt a
+static Vector2d tangent(const Vector2d &a, double R, double sigma, Matrix2d &D)
+{
+	Matrix2d J;
+	J << 0.0, 1.0, -1.0, 0.0;
+	double d = a.squaredNorm();
+	double root = sqrt(d - R*R);
+	Vector2d Ja = J * a;
+	Vector2d x = (R*R * a + sigma * R * root * Ja) / d;
+	D = (R*R * Matrix2d::Identity() + sigma * R * root * J + sigma * R / root * Ja * a.transpose()) / d
+		- 2.0 / d * x * a.transpose();
+	return x;
+}
+
+// Gradient wrt a of the arc k acos(1 - |a - b|^2 / (2 R^2)), the one wrt b is its negative
+static RowVector2d arcGradient(const Vector2d &a, const Vector2d &b, double R, double k)
+{
+	double c = 1.0 - 0.5 * (a - b).squaredNorm() / (R*R);
+	double sin2 = 1.0 - c*c;
+	if (sin2 <= 0.0) {
+		return RowVector2d::Zero();
+	}
+	return k / (R*R * sqrt(sin2)) * (a - b).transpose();
+}
+
+void WrapObst::computeTangentDerivatives(const Vector3d &A, const Vector3d &B, double R, double k, bool isArcSides,
+	Matrix<double, 3, 6> &dx, Matrix<double, 3, 6> &dy, Matrix<double, 1, 6> &darc)
+{
+	Vector2d a = A.head<2>();
+	Vector2d b = B.head<2>();
+	Matrix2d Dx, Dy;
+	Vector2d x = tangent(a, R, 1.0, Dx);
+	Vector2d y = tangent(b, R, -1.0, Dy);
+
+	dx.setZero();
+	dy.setZero();
+	dx.block<2, 2>(0, 0) = Dx;
+	dy.block<2, 2>(0, 3) = Dy;
+
+	RowVector2d g = arcGradient(x, y, R, k);
+	double arc = k * safeAcos(1.0 - 0.5 * (x - y).squaredNorm() / (R*R));
+	if (arc < 0.5 * k * PI && g.isZero()) {
+		// Zero arc, where the path just touches the obstacle. The acos has no gradient there,
+		// its limit from the wrapping side is k / R along the circle at x, which the sign of R
+		// turns around as it does the tangents.
+		g = k / (R * abs(R)) * Vector2d(-x(1), x(0)).transpose();
+	}
+	darc.setZero();
+	darc.segment<2>(0) = g * Dx;
+	darc.segment<2>(3) = -g * Dy;
+
+	// Side lengths from A to x and from y to B, and their gradients with x and y held
+	double sa, sb;
+	RowVector2d ua, vb;
+	if (isArcSides) {
+		sa = k * safeAcos(1.0 - 0.5 * (a - x).squaredNorm() / (R*R));
+		sb = k * safeAcos(1.0 - 0.5 * (y - b).squaredNorm() / (R*R));
+		ua = arcGradient(a, x, R, k);
+		vb = arcGradient(y, b, R, k);
+	}
+	else {
+		sa = (a - x).norm();
+		sb = (y - b).norm();
+		ua = (a - x).transpose() / sa;
+		vb = (y - b).transpose() / sb;
+	}
+	Matrix<double, 1, 6> ga, gb, gsum, gdz;
+	ga.setZero();
+	gb.setZero();
+	ga.segment<2>(0) = ua * (Matrix2d::Identity() - Dx);
+	gb.segment<2>(3) = vb * (Dy - Matrix2d::Identity());
+	gsum = ga + darc + gb;
+	gdz.setZero();
+	gdz(2) = -1.0;
+	gdz(5) = 1.0;
+
+	// x_z = A_z + dz * sa / sum and y_z = B_z - dz * sb / sum
+	double sum = sa + arc + sb;
+	double dz = B(2) - A(2);
+	dx.row(2) = sa / sum * gdz + dz / (sum*sum) * (sum * ga - sa * gsum);
+	dx(2, 2) += 1.0;
+	dy.row(2) = -sb / sum * gdz - dz / (sum*sum) * (sum * gb - sb * gsum);
+	dy(2, 5) += 1.0;
+}
+
+void WrapObst::computeObstacleDerivatives(const Vector3d &A, const Vector3d &B, const Vector3d &O, const Vector3d &z,
+	const Vector3d *X, const MatrixXd &dA, const MatrixXd &dB, MatrixXd &dO, MatrixXd &dz)
+{
+	// Translation: dO = -(dA + dB), plus the point itself moving along
+	// Rotation about O by w: A and B turn by -w, then the output turns by w
+	dO = -dA - dB;
+	MatrixXd dw = dA * Rigid::bracket3(A - O) + dB * Rigid::bracket3(B - O);
+	if (X) {
+		dO += Matrix3d::Identity();
+		dw -= Rigid::bracket3(*X - O);
+	}
+
+	// A change dz normal to z is the rotation w = z x dz / |z|^2. Along z nothing changes,
+	// since compute() normalizes the axis.
+	dz = dw * Rigid::bracket3(z) / z.squaredNorm();
+}
+
+void WrapObst::updateTotalLength(const Vector3d &Q, const Vector3d &T, bool isWrapped)
+{
+	if (isWrapped) {
+		total_length = (point_P - Q).norm() + path_length + (T - point_S).norm();
+	}
+	else {
+		total_length = (point_P - point_S).norm();
+	}
+}
+
+void WrapObst::updateTotalLengthDerivative(const Vector3d &Q, const Vector3d &T, bool isWrapped)
+{
+	if (!isWrapped) {
+		dTotal.setZero(1, dL.cols());
+		Vector3d PS = point_P - point_S;
+		double l = PS.norm();
+		if (l > 0.0) {
+			dTotal.block<1, 3>(0, 0) = PS.transpose() / l;
+			dTotal.block<1, 3>(0, 3) = -PS.transpose() / l;
+		}
+		return;
+	}
+
+	// d|P - Q| = u^T (dP - dQ) and d|T - S| = v^T (dT - dS), with u and v the unit sides
+	dTotal = dL;
+	Vector3d PQ = point_P - Q;
+	double l_PQ = PQ.norm();
+	if (l_PQ > 0.0) {
+		RowVector3d u = PQ.transpose() / l_PQ;
+		dTotal.block<1, 3>(0, 0) += u;
+		dTotal.noalias() -= u * dQ;
+	}
+	Vector3d TS = T - point_S;
+	double l_TS = TS.norm();
+	if (l_TS > 0.0) {
+		RowVector3d v = TS.transpose() / l_TS;
+		dTotal.block<1, 3>(0, 3) -= v;
+		dTotal.noalias() += v * dT;
+	}
+}
+
+void WrapObst::computePointJacobian(const shared_ptr<Particle> &x, int num_joints, MatrixXd &J)
+{
+	x->getParent()->computePointJacobian(x->x0, num_joints, J);
+}
+
+void WrapObst::computeDirectionJacobian(const shared_ptr<::Vector> &z, int num_joints, MatrixXd &J)
+{
+	// The direction is the difference of two points on the body, so is its Jacobian
+	auto p = z->getP();
+	MatrixXd J0;
+	computePointJacobian(p, num_joints, J0);
+	p->getParent()->computePointJacobian(p->x0 + z->dir0, num_joints, J);
+	J -= J0;
+}
+
+vector<int> WrapObst::computeJointIds(const vector<shared_ptr<Particle>> &inputs)
+{
+	vector<int> ids;
+	for (auto x : inputs) {
+		const Rigid *box = x->getParent().get();
+		while (box->getIndex() != 0) {
+			ids.push_back(box->getIndex() - 1);
+			box = box->getParent().get();
+		}
+	}
+	sort(ids.begin(), ids.end());
+	ids.erase(unique(ids.begin(), ids.end()), ids.end());
+	return ids;
+}
+
+bool WrapObst::stepTable()
+{
+	isBatchPending = false;
+	isTabulated = table && table->update();
+	if (!isTabulated) {
+		return false;
+	}
+	total_length = table->getLength();
+	wrap_margin = table->getWrapMargin();
+	status = table->isWrapped() ? wrap : no_wrap;
+	return true;
+}
+
+bool WrapObst::stepBatch()
+{
+	isBatchPending = isBatched && !isDerivatives && !isCheckDerivatives;
+	return isBatchPending;
+}
+
+void WrapObst::setBatchResults(const WrapBatch &batch, int i)
+{
+	M.row(0) = batch.ex.col(i).matrix().transpose();
+	M.row(1) = batch.ey.col(i).matrix().transpose();
+	M.row(2) = batch.ez.col(i).matrix().transpose();
+	point_q = batch.q.col(i).matrix();
+	point_t = batch.t.col(i).matrix();
+	status = (Status)batch.status(i);
+	path_length = batch.length(i);
+	wrap_margin = batch.margin(i);
+	updateTotalLength(batch.Q.col(i).matrix(), batch.T.col(i).matrix(), status == wrap);
+	++version;
+	isBatchPending = false;
+}
+
+bool WrapObst::getTableMomentArms(int num_joints, VectorXd &arms) const
+{
+	if (!isTabulated) {
+		return false;
+	}
+	arms.setZero(num_joints);
+	VectorXd table_arms = table->getMomentArms();
+	const vector<int> &ids = table->getJointIds();
+	for (int i = 0; i < (int)ids.size(); ++i) {
+		arms(ids[i]) = table_arms(i);
+	}
+	return true;
+}
@@ -2,12 +2,20 @@
 #ifndef MUSCLEMASS_SRC_WRAPOBST_H_
 #define MUSCLEMASS_SRC_WRAPOBST_H_
 
+#define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 
 #include <cmath>
 #include <iostream>
 #include <stdlib.h>
-#include <complex>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class Particle;
+class Vector;
+class WrapTable;
+class WrapBatch;
 
 enum Status { wrap, inside_radius, no_wrap, empty };
 enum Type { none, sphere, cylinder, double_cylinder };
@@ -23,12 +31,93 @@ protected:
 		point_q,    // Obstacle Via Point 1 in Obstacle Frame
 		point_t;    // Obstacle Via Point 2 in Obstacle Frame
 
-	Eigen::MatrixXd M;  // Obstacle Coord Transformation Matrix
+	Eigen::Matrix3d M;  // Obstacle Coord Transformation Matrix
 	Status status;      // Wrapping Status
 	Type type;          // Obstacle Type
 	double path_length,  // Wrapping Path Length
+		total_length,	// P to S along the path, the straight sides and path_length
+		wrap_margin,	// sin of the signed arc from q to t, the path wraps where it is >= 0
 		radius;       // obstacle sphere radius
 
+	// Derivatives wrt the inputs of compute(), filled by computeDerivatives().
+	// Each input is a world point or direction and owns 3 columns, in the order
+	// listed by the derived class.
+	Eigen::MatrixXd
+		dL,         // 1 x 3n gradient of path_length
+		dQ,         // 3 x 3n Jacobian of the world tangent point next to P
+		dT,         // 3 x 3n Jacobian of the world tangent point next to S
+		dTotal;     // 1 x 3n gradient of total_length
+	bool isDerivatives;			// fill the derivatives in step()
+	bool isCheckDerivatives;	// compare them against finite differences in step()
+	std::shared_ptr<WrapTable> table;	// serves step() instead of compute() when set, see stepTable()
+	bool isTabulated;			// the last step() was served by the table
+	bool isBatched;				// step() leaves compute() to a WrapBatch, see stepBatch()
+	bool isBatchPending;		// the last step() did, setBatchResults() has not run since
+	int version;				// bumped by every compute() in step(), the arc points are cached against it
+
+	// In the obstacle frame, tangent point x from A and y from B on the circle of radius R
+	// about the z axis, with the arc k acos between them and the heights of x and y split
+	// in proportion to the side lengths (straight, or arcs as in WrapDoubleCylinder).
+	// Jacobians of x, y and the arc wrt [A; B].
+	static void computeTangentDerivatives(const Eigen::Vector3d &A, const Eigen::Vector3d &B,
+		double R, double k, bool isArcSides,
+		Eigen::Matrix<double, 3, 6> &dx, Eigen::Matrix<double, 3, 6> &dy, Eigen::Matrix<double, 1, 6> &darc);
+
+	// Derivatives wrt the center O and the axis z of an obstacle from those wrt the two points
+	// A and B wrapping around it. Moving the obstacle rigidly is the same as moving A and B
+	// back and then everything forward. X is the output point, or null for a scalar output.
+	static void computeObstacleDerivatives(const Eigen::Vector3d &A, const Eigen::Vector3d &B,
+		const Eigen::Vector3d &O, const Eigen::Vector3d &z, const Eigen::Vector3d *X,
+		const Eigen::MatrixXd &dA, const Eigen::MatrixXd &dB, Eigen::MatrixXd &dO, Eigen::MatrixXd &dz);
+
+	// Jacobians wrt the joint angles of a point, or a direction, fixed on the parent of x
+	static void computePointJacobian(const std::shared_ptr<Particle> &x, int num_joints, Eigen::MatrixXd &J);
+	static void computeDirectionJacobian(const std::shared_ptr<Vector> &z, int num_joints, Eigen::MatrixXd &J);
+
+	// Indices of the joints between the root and the parents of the inputs, sorted
+	static std::vector<int> computeJointIds(const std::vector<std::shared_ptr<Particle>> &inputs);
+
+	// total_length from the world tangent points Q and T at the end of compute(), or the
+	// straight line from P to S when the path does not wrap
+	void updateTotalLength(const Eigen::Vector3d &Q, const Eigen::Vector3d &T, bool isWrapped);
+	// dTotal from dL, dQ and dT, with P and S the inputs in columns 0 and 3
+	void updateTotalLengthDerivative(const Eigen::Vector3d &Q, const Eigen::Vector3d &T, bool isWrapped);
+
+	// total_length, wrap_margin and status from the table at the current joint angles, false
+	// without a table or outside its range, where step() solves instead. The arc is not
+	// tabulated, path_length keeps the value of the last solve while a table serves the obstacle.
+	bool stepTable();
+	// True when step() should leave compute() to the WrapBatch of the scene. The batch has no
+	// derivatives, an obstacle that needs them solves on its own.
+	bool stepBatch();
+	// The tabulated moment arms spread over all the joints, false unless the last step() was
+	// served by the table
+	bool getTableMomentArms(int num_joints, Eigen::VectorXd &arms) const;
+
+	// Largest difference between [dL; dTotal; dQ; dT] and central differences of outputs(),
+	// which runs compute() and returns [path_length; total_length; Q; T]. The inputs are the
+	// members compute() reads, in the column order of dL.
+	template <typename Outputs>
+	double checkDerivatives(const std::vector<Eigen::Vector3d *> &inputs, Outputs outputs, double h)
+	{
+		Eigen::MatrixXd D(8, dL.cols());
+		D << dL, dTotal, dQ, dT;
+		double err = 0.0;
+		for (int i = 0; i < (int)inputs.size(); i++) {
+			for (int j = 0; j < 3; j++) {
+				double x = (*inputs[i])(j);
+				(*inputs[i])(j) = x + h;
+				Eigen::VectorXd f1 = outputs();
+				(*inputs[i])(j) = x - h;
+				Eigen::VectorXd f0 = outputs();
+				(*inputs[i])(j) = x;
+				err = std::max(err, ((f1 - f0) / (2.0 * h) - D.col(3 * i + j)).cwiseAbs().maxCoeff());
+			}
+		}
+		outputs();
+		return err;
+	}
+
 public:
 	// set muscle origin point
 	void setOrigin(const Eigen::Vector3d &P)
@@ -47,11 +136,19 @@ public:
 	{
 		point_P = point_S = point_O = point_q = point_t
 			= Eigen::Vector3d(0.0, 0.0, 0.0);
-		M = Eigen::MatrixXd(3, 3);
+		M.setIdentity();
 		status = empty;
 		path_length = 0.0;
+		total_length = 0.0;
+		wrap_margin = 0.0;
 		radius = 0.0;
 		type = none;
+		isDerivatives = false;
+		isCheckDerivatives = false;
+		isTabulated = false;
+		isBatched = false;
+		isBatchPending = false;
+		version = 0;
 	}
 
 	// constructor
@@ -62,10 +159,18 @@ public:
 		point_P(P), point_S(S), point_O(O), radius(R)
 	{
 		point_q = point_t = Eigen::Vector3d(0.0, 0.0, 0.0);
-		M = Eigen::MatrixXd(3, 3);
+		M.setIdentity();
 		status = empty;
 		path_length = 0.0;
+		total_length = 0.0;
+		wrap_margin = 0.0;
 		type = none;
+		isDerivatives = false;
+		isCheckDerivatives = false;
+		isTabulated = false;
+		isBatched = false;
+		isBatchPending = false;
+		version = 0;
 	}
 
 	// wrap calculation
@@ -76,6 +181,16 @@ public:
 		return this->path_length;
 	}
 
+	double getTotalLength() const
+	{
+		return this->total_length;
+	}
+
+	double getWrapMargin() const
+	{
+		return this->wrap_margin;
+	}
+
 	Status getStatus() const
 	{
 		return this->status;
@@ -86,6 +201,29 @@ public:
 		return this->radius;
 	}
 
+	void setDerivatives(bool _isDerivatives) { this->isDerivatives = _isDerivatives; }
+	void setCheckDerivatives(bool _isCheckDerivatives) { this->isCheckDerivatives = _isCheckDerivatives; }
+
+	void setTable(std::shared_ptr<WrapTable> _table) { this->table = _table; }
+	std::shared_ptr<WrapTable> getTable() const { return this->table; }
+
+	void setBatched(bool _isBatched) { this->isBatched = _isBatched; }
+	bool getBatched() const { return this->isBatched; }
+	bool getBatchPending() const { return this->isBatchPending; }
+	// The outputs of compute() from column i of a batch that the inputs of the last step() went to
+	void setBatchResults(const WrapBatch &batch, int i);
+
+	const Eigen::MatrixXd &getLengthDerivative() const { return this->dL; }
+	const Eigen::MatrixXd &getQDerivative() const { return this->dQ; }
+	const Eigen::MatrixXd &getTDerivative() const { return this->dT; }
+	const Eigen::MatrixXd &getTotalLengthDerivative() const { return this->dTotal; }
+
+	// acos of the chord cosine 1 - c^2 / (2 R^2), which rounding can push just outside [-1, 1]
+	static double safeAcos(double x)
+	{
+		return std::acos(std::min(1.0, std::max(-1.0, x)));
+	}
+
 	Eigen::MatrixXd getPoints() {}
 
 };
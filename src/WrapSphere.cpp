@@ -1,8 +1,10 @@
 #include "WrapSphere.h"
 #include <iostream>
+#ifndef ML_HEADLESS
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -10,23 +12,24 @@
 
 #include "WrapCylinder.h"
 #include "Shape.h"
+#ifndef ML_HEADLESS
 #include "Program.h"
+#endif
 #include "MatrixStack.h"
 #include "Rigid.h"
 #include "Particle.h"
 #include "Vector.h"
+#include "WrapBatch.h"
 
 using namespace std;
 using namespace Eigen;
 
 void WrapSphere::compute()
 {
-	Eigen::Vector3d OS = this->point_S - this->point_O;
-	OS = OS / OS.norm();
+	// N is normalized after the cross product, so OP can keep its length
+	Eigen::Vector3d OS = (this->point_S - this->point_O).normalized();
 	Eigen::Vector3d OP = this->point_P - this->point_O;
-	OP = OP / OP.norm();
-	Eigen::Vector3d N = OP.cross(OS);
-	N = N / N.norm();
+	Eigen::Vector3d N = OP.cross(OS).normalized();
 	if (N.dot(Eigen::Vector3d(0.0, 0.0, 1.0)) < 0) {
 		N = -N;
 	}
@@ -58,6 +61,7 @@ void WrapSphere::compute()
 	t(0) = (s(0) * R*R - R * s(1) * root_t) / denom_t;
 	t(1) = (s(1) * R*R + R * s(0) * root_t) / denom_t;
 
+	this->wrap_margin = -R * (q(0) * t(1) - q(1) * t(0)) / (R*R * abs(R));
 	if (R * (q(0) * t(1) - q(1) * t(0)) > 0.0)
 	{
 		this->status = no_wrap;
@@ -74,12 +78,105 @@ void WrapSphere::compute()
 
 	//  std::cout << Q.transpose() << std::endl << T.transpose() << std::endl;
 
-	this->path_length = R * acos(1.0 - 0.5 *
-		((Q(0) - T(0)) * (Q(0) - T(0))
-			+ (Q(1) - T(1)) * (Q(1) - T(1))) / (R*R));
+	// q and t lie in the z = 0 plane of the obstacle frame, so this is the full chord
+	this->path_length = R * safeAcos(1.0 - 0.5 *
+		((q(0) - t(0)) * (q(0) - t(0))
+			+ (q(1) - t(1)) * (q(1) - t(1))) / (R*R));
+	updateTotalLength(Q, T, this->status == wrap);
 }
 
-Eigen::MatrixXd WrapSphere::getPoints(int num_points)
+void WrapSphere::computeDerivatives()
+{
+	dL.resize(1, 9);
+	dQ.resize(3, 9);
+	dT.resize(3, 9);
+	if (this->status == inside_radius) {
+		dL.setZero();
+		dQ.setZero();
+		dT.setZero();
+		updateTotalLengthDerivative(Vector3d::Zero(), Vector3d::Zero(), false);
+		return;
+	}
+
+	// Within the plane of O, P and S the frame can be held fixed, as for the cylinder
+	Eigen::Vector3d p = this->M * (this->point_P - this->point_O);
+	Eigen::Vector3d s = this->M * (this->point_S - this->point_O);
+	Eigen::Matrix<double, 3, 6> dq, dt;
+	Eigen::Matrix<double, 1, 6> darc;
+	computeTangentDerivatives(p, s, this->radius, this->radius, false, dq, dt, darc);
+
+	Matrix3d dq_p, dq_s, dt_p, dt_s;
+	dq_p.setZero();
+	dq_s.setZero();
+	dt_p.setZero();
+	dt_s.setZero();
+	dq_p.topLeftCorner<2, 2>() = dq.block<2, 2>(0, 0);
+	dq_s.topLeftCorner<2, 2>() = dq.block<2, 2>(0, 3);
+	dt_p.topLeftCorner<2, 2>() = dt.block<2, 2>(0, 0);
+	dt_s.topLeftCorner<2, 2>() = dt.block<2, 2>(0, 3);
+
+	// Out of the plane, P turns the plane about OS by N.dP / p_y and S turns it about OP,
+	// which carries q and t along N. The arc does not change.
+	Eigen::Vector3d N = this->M.row(2).transpose();
+	Matrix3d NN = N * N.transpose();
+	const Eigen::Vector3d &q = this->point_q;
+	const Eigen::Vector3d &t = this->point_t;
+	double k_S = -1.0 / (p(1) * s(0));
+
+	Matrix3d MT = this->M.transpose();
+	dL.block<1, 3>(0, 0) = Eigen::RowVector3d(darc(0), darc(1), 0.0) * this->M;
+	dL.block<1, 3>(0, 3) = Eigen::RowVector3d(darc(3), darc(4), 0.0) * this->M;
+	dQ.block<3, 3>(0, 0) = MT * dq_p * this->M + q(1) / p(1) * NN;
+	dQ.block<3, 3>(0, 3) = MT * dq_s * this->M + k_S * (p(0) * q(1) - p(1) * q(0)) * NN;
+	dT.block<3, 3>(0, 0) = MT * dt_p * this->M + t(1) / p(1) * NN;
+	dT.block<3, 3>(0, 3) = MT * dt_s * this->M + k_S * (p(0) * t(1) - p(1) * t(0)) * NN;
+
+	// Moving O is moving P and S the other way, then everything with O
+	dL.block<1, 3>(0, 6) = -dL.block<1, 3>(0, 0) - dL.block<1, 3>(0, 3);
+	dQ.block<3, 3>(0, 6) = Matrix3d::Identity() - dQ.block<3, 3>(0, 0) - dQ.block<3, 3>(0, 3);
+	dT.block<3, 3>(0, 6) = Matrix3d::Identity() - dT.block<3, 3>(0, 0) - dT.block<3, 3>(0, 3);
+	updateTotalLengthDerivative(MT * q + this->point_O, MT * t + this->point_O, this->status == wrap);
+}
+
+double WrapSphere::checkDerivatives(double h)
+{
+	return WrapObst::checkDerivatives({ &point_P, &point_S, &point_O }, [this]() {
+		compute();
+		VectorXd f(8);
+		f << this->path_length, this->total_length, this->M.transpose() * this->point_q + this->point_O, this->M.transpose() * this->point_t + this->point_O;
+		return f;
+	}, h);
+}
+
+void WrapSphere::computeInputJacobian(int num_joints, MatrixXd &J) const
+{
+	J.resize(9, num_joints);
+	MatrixXd Ji;
+	computePointJacobian(P, num_joints, Ji);
+	J.middleRows<3>(0) = Ji;
+	computePointJacobian(S, num_joints, Ji);
+	J.middleRows<3>(3) = Ji;
+	computePointJacobian(O, num_joints, Ji);
+	J.middleRows<3>(6) = Ji;
+}
+
+VectorXd WrapSphere::computeMomentArms(int num_joints) const
+{
+	VectorXd arms;
+	if (getTableMomentArms(num_joints, arms)) {
+		return arms;
+	}
+	MatrixXd J;
+	computeInputJacobian(num_joints, J);
+	return -(dTotal * J).transpose();
+}
+
+vector<int> WrapSphere::getJointIds() const
+{
+	return computeJointIds({ P, S, O });
+}
+
+Eigen::MatrixXd WrapSphere::getPoints(int num_points) const
 {
 	double theta_q = atan(this->point_q(1) / this->point_q(0));
 	if (this->point_q(0) < 0.0)
@@ -128,16 +225,45 @@ void WrapSphere::reset() {
 }
 
 void WrapSphere::step() {
+	// The inputs stay current under a table as well, for drawing
 	this->point_P = P->x;
 	this->point_S = S->x;
 	this->point_O = O->x;
+	if (stepTable() || stepBatch()) {
+		return;
+	}
 	compute();
-	if (this->status == wrap) {
+	++version;
+	if (isDerivatives || isCheckDerivatives) {
+		computeDerivatives();
+	}
+	if (isCheckDerivatives) {
+		cout << "Wrap derivative error: " << checkDerivatives(1e-6) << endl;
+	}
+}
+
+void WrapSphere::getBatchInputs(WrapBatch &batch, int i) const
+{
+	batch.P.col(i) = point_P.array();
+	batch.S.col(i) = point_S.array();
+	batch.O.col(i) = point_O.array();
+	batch.R(i) = this->radius;
+}
+
+const MatrixXd &WrapSphere::getArcPoints() const
+{
+	if (isTabulated || this->status != wrap) {
+		arc_points.resize(3, 0);
+	}
+	else if (arc_version != version) {
 		arc_points = getPoints(num_points);
+		arc_version = version;
 	}
+	return arc_points;
 }
 
 void WrapSphere::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const {
+#ifndef ML_HEADLESS
 
 	prog->bind();
 	glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
@@ -172,15 +298,15 @@ void WrapSphere::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Pro
 	glBegin(GL_LINE_STRIP);
 	glVertex3f(this->point_S(0), this->point_S(1), this->point_S(2));
 
-	if (this->status == wrap) {
-		for (int i = 0; i < this->arc_points.cols(); i++) {
-			Vector3f p = this->arc_points.block<3, 1>(0, i).cast<float>();
-			glVertex3f(p(0), p(1), p(2));
-		}
+	const MatrixXd &arc = getArcPoints();
+	for (int i = 0; i < arc.cols(); i++) {
+		Vector3f p = arc.block<3, 1>(0, i).cast<float>();
+		glVertex3f(p(0), p(1), p(2));
 	}
 
 	glVertex3f(this->point_P(0), this->point_P(1), this->point_P(2));
 	glEnd();
 	MV->popMatrix();
 	prog2->unbind();
+#endif
 }
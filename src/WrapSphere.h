@@ -28,7 +28,8 @@ class Rigid;
 class WrapSphere : public WrapObst
 {
 private:
-	Eigen::MatrixXd arc_points; // each col stores the position of a point in that arc
+	mutable Eigen::MatrixXd arc_points; // each col stores the position of a point in that arc
+	mutable int arc_version;	// version the arc points belong to
 
 	std::shared_ptr<Rigid> parent;
 	std::shared_ptr<Particle> P;
@@ -42,6 +43,7 @@ public:
 	WrapSphere()
 	{
 		type = sphere;
+		arc_version = -1;
 	}
 
 	void setSphereConfig(const Eigen::Vector3d &O)
@@ -55,14 +57,30 @@ public:
 	{
 		this->radius = R;
 		type = sphere;
-		arc_points.resize(3, this->num_points + 1);
+		arc_version = -1;
 	}
 
 	using WrapObst::compute;
 	void compute();
 
 	using WrapObst::getPoints;
-	Eigen::MatrixXd getPoints(int num_points);
+	Eigen::MatrixXd getPoints(int num_points) const;
+	// The points along the wrapped path of the last step, computed the first time they are
+	// asked for. Empty when unwrapped or served from a table.
+	const Eigen::MatrixXd &getArcPoints() const;
+	// The inputs of the last step() into column i of a batch, see WrapObst::setBatchResults()
+	void getBatchInputs(WrapBatch &batch, int i) const;
+
+	// Derivatives wrt the inputs P, S, O, see WrapObst
+	void computeDerivatives();
+	double checkDerivatives(double h);
+
+	// Jacobian of the inputs wrt the joint angles, 3 rows per input
+	void computeInputJacobian(int num_joints, Eigen::MatrixXd &J) const;
+	// -d total_length / dtheta, the moment arms of the path from P to S about each joint
+	Eigen::VectorXd computeMomentArms(int num_joints) const;
+	// Joints the inputs depend on, the angles of a WrapTable for this obstacle
+	std::vector<int> getJointIds() const;
 
 	void reset();
 	void step();
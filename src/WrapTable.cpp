@@ -0,0 +1,261 @@
+#include "WrapTable.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Sparse>
+
+#include "Joint.h"
+#include "MLError.h"
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+WrapTable::WrapTable() :
+	type(MLBasisFunction::LINEAR_BSPLINE),
+	num_knots(2),
+	num_margins(1)
+{
+	theta_min.resize(0);
+	theta_max.resize(0);
+	coeffs.resize(2, 1);
+	coeffs.setZero();
+	init();
+}
+
+WrapTable::~WrapTable()
+{
+}
+
+void WrapTable::init()
+{
+	int d = (int)joint_ids.size();
+	if (type == MLBasisFunction::LINEAR_BSPLINE) {
+		width = 2;
+		offset = 0;
+		support = 1.0;
+	}
+	else {
+		width = 4;
+		offset = 1;
+		support = 2.0;
+	}
+	num_basis = num_knots + 2 * offset;
+	spacing = (theta_max - theta_min) / (num_knots - 1);
+	strides.resize(d);
+	int stride = 1;
+	for (int i = 0; i < d; i++) {
+		strides(i) = stride;
+		stride *= num_basis;
+	}
+
+	theta.resize(d);
+	u.resize(d);
+	values.resize(coeffs.rows());
+	values.setZero();
+	first.resize(d);
+	weights.resize(width, d);
+	corner.resize(d);
+}
+
+MLBasisFunction *WrapTable::newBasisFunction(const VectorXi &k) const
+{
+	// In knot units, basis function k is centered on knot k - offset
+	VectorXd center = (k.array() - offset).cast<double>();
+	VectorXd s = VectorXd::Constant(k.size(), support);
+	if (type == MLBasisFunction::LINEAR_BSPLINE) {
+		return new MLLinearBSpline(center, s, 1.0);
+	}
+	return new MLCubicBSpline(center, s, 1.0);
+}
+
+void WrapTable::locate(const VectorXd &u)
+{
+	for (int i = 0; i < (int)u.size(); i++) {
+		double t = min(max(u(i), 0.0), num_knots - 1.0);
+		int m = min((int)floor(t), num_knots - 2);
+		first(i) = m;
+		for (int k = 0; k < width; k++) {
+			double x = (t - (m + k - offset)) / support;
+			weights(k, i) = (type == MLBasisFunction::LINEAR_BSPLINE) ? MLLinearBSpline::value(x) : MLCubicBSpline::value(x);
+		}
+	}
+}
+
+VectorXd WrapTable::fit(MLBasisFunction::MLBasisFunctionType _type,
+	const vector<int> &_joint_ids,
+	const VectorXd &_theta_min,
+	const VectorXd &_theta_max,
+	int _num_knots,
+	int _num_margins,
+	const function<void(const VectorXd &, VectorXd &)> &f)
+{
+	this->type = _type;
+	this->joint_ids = _joint_ids;
+	this->theta_min = _theta_min;
+	this->theta_max = _theta_max;
+	this->num_knots = max(_num_knots, 2);
+	this->num_margins = _num_margins;
+	int num_channels = 1 + num_margins + (int)joint_ids.size();
+	this->coeffs.resize(num_channels, 1);
+	init();
+
+	int d = (int)joint_ids.size();
+	int num_cols = 1;
+	int num_rows = 1;
+	int num_corners = 1;
+	int m = 2 * num_knots - 1;	// samples per angle, the knots and the midpoints
+	for (int i = 0; i < d; i++) {
+		num_cols *= num_basis;
+		num_rows *= m;
+		num_corners *= width;
+	}
+
+	vector<unique_ptr<MLBasisFunction>> basis(num_cols);
+	VectorXi k(d);
+	for (int c = 0; c < num_cols; c++) {
+		for (int i = 0; i < d; i++) {
+			k(i) = (c / strides(i)) % num_basis;
+		}
+		basis[c].reset(newBasisFunction(k));
+	}
+
+	// Sample f and the basis functions that are nonzero at each sample
+	MatrixXd Y(num_rows, num_channels);
+	vector<Triplet<double>> entries;
+	entries.reserve(num_rows * num_corners);
+	VectorXd y(num_channels);
+	for (int r = 0; r < num_rows; r++) {
+		for (int i = 0, s = r; i < d; i++, s /= m) {
+			u(i) = 0.5 * (s % m);
+		}
+		theta = theta_min + u.cwiseProduct(spacing);
+		f(theta, y);
+		if (!y.allFinite()) {
+			// Left out, e.g. an insertion inside the obstacle
+			Y.row(r).setZero();
+			continue;
+		}
+		Y.row(r) = y.transpose();
+
+		locate(u);
+		corner.setZero();
+		for (int j = 0; j < num_corners; j++) {
+			int c = 0;
+			for (int i = 0; i < d; i++) {
+				c += (first(i) + corner(i)) * strides(i);
+			}
+			double w;
+			basis[c]->eval(u, &w);
+			if (w != 0.0) {
+				entries.push_back(Triplet<double>(r, c, w));
+			}
+			for (int i = 0; i < d && ++corner(i) == width; i++) {
+				corner(i) = 0;
+			}
+		}
+	}
+	SparseMatrix<double> A(num_rows, num_cols);
+	A.setFromTriplets(entries.begin(), entries.end());
+
+	// Normal equations, slightly regularized since the outer cubic functions only reach
+	// into the range by one interval
+	SparseMatrix<double> I(num_cols, num_cols);
+	I.setIdentity();
+	SparseMatrix<double> AtA = SparseMatrix<double>(A.transpose()) * A + 1e-10 * I;
+	SimplicialLDLT<SparseMatrix<double>> solver(AtA);
+	if (solver.info() != Success) {
+		cout << "WrapTable: the fit failed to factorize" << endl;
+		coeffs.setZero(num_channels, num_cols);
+		return VectorXd::Constant(num_channels, INFINITY);
+	}
+	MatrixXd C = solver.solve(A.transpose() * Y);
+	coeffs = C.transpose();
+	return (A * C - Y).cwiseAbs().colwise().maxCoeff().transpose();
+}
+
+void WrapTable::eval(const VectorXd &x, VectorXd &f)
+{
+	int d = (int)joint_ids.size();
+	for (int i = 0; i < d; i++) {
+		u(i) = (x(i) - theta_min(i)) / spacing(i);
+	}
+	locate(u);
+
+	int num_corners = 1;
+	for (int i = 0; i < d; i++) {
+		num_corners *= width;
+	}
+	f.resize(coeffs.rows());
+	f.setZero();
+	corner.setZero();
+	for (int j = 0; j < num_corners; j++) {
+		double w = 1.0;
+		int c = 0;
+		for (int i = 0; i < d; i++) {
+			w *= weights(corner(i), i);
+			c += (first(i) + corner(i)) * strides(i);
+		}
+		f.noalias() += w * coeffs.col(c);
+		for (int i = 0; i < d && ++corner(i) == width; i++) {
+			corner(i) = 0;
+		}
+	}
+}
+
+bool WrapTable::update()
+{
+	for (int i = 0; i < (int)joint_ids.size(); i++) {
+		theta(i) = joints[joint_ids[i]]->getTheta();
+		if (theta(i) < theta_min(i) || theta(i) > theta_max(i)) {
+			return false;
+		}
+	}
+	eval(theta, values);
+	return true;
+}
+
+void WrapTable::setJoints(const vector<shared_ptr<Joint>> &scene_joints)
+{
+	this->joints = scene_joints;
+}
+
+json WrapTable::toJson() const
+{
+	json j;
+	j["basis"] = (type == MLBasisFunction::LINEAR_BSPLINE) ? "linear" : "cubic";
+	j["joints"] = joint_ids;
+	j["theta_min"] = vector<double>(theta_min.data(), theta_min.data() + theta_min.size());
+	j["theta_max"] = vector<double>(theta_max.data(), theta_max.data() + theta_max.size());
+	j["num_knots"] = num_knots;
+	j["num_margins"] = num_margins;
+	json jc = json::array();
+	for (int i = 0; i < (int)coeffs.rows(); i++) {
+		VectorXd row = coeffs.row(i);
+		jc.push_back(vector<double>(row.data(), row.data() + row.size()));
+	}
+	j["coefficients"] = jc;
+	return j;
+}
+
+void WrapTable::fromJson(const json &j)
+{
+	type = (j["basis"] == "cubic") ? MLBasisFunction::CUBIC_BSPLINE : MLBasisFunction::LINEAR_BSPLINE;
+	joint_ids = j["joints"].get<vector<int>>();
+	vector<double> tmin = j["theta_min"];
+	vector<double> tmax = j["theta_max"];
+	theta_min = Map<VectorXd>(tmin.data(), tmin.size());
+	theta_max = Map<VectorXd>(tmax.data(), tmax.size());
+	num_knots = j["num_knots"];
+	num_margins = j["num_margins"];
+
+	const json &jc = j["coefficients"];
+	coeffs.resize(jc.size(), jc.empty() ? 0 : jc[0].size());
+	for (int i = 0; i < (int)jc.size(); i++) {
+		vector<double> row = jc[i];
+		coeffs.row(i) = Map<RowVectorXd>(row.data(), row.size());
+	}
+	init();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef MUSCLEMASS_SRC_WRAPTABLE_H_
+#define MUSCLEMASS_SRC_WRAPTABLE_H_
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <json.hpp>
+
+#include "MLBasisFunction.h"
+
+class Joint;
+
+// Outputs of one wrap obstacle as tensor product B-splines over the joint angles it
+// depends on. The channels are the full path length from P to S, the wrap margin of each
+// surface and the moment arm about each of those joints. The margins, U and V for the double
+// cylinder, are continuous where the path starts or stops wrapping, unlike the status, and
+// the path wraps where they are >= 0. Scene::tabulateWraps() fits the table offline from the
+// wrap solve, then update() evaluates it in constant time at runtime.
+//
+// The knots are uniform over [theta_min, theta_max]. A linear table has one hat per knot,
+// a cubic one has one more basis function past each end. eval() clamps angles outside the
+// range, update() declines them so the obstacle solves there instead.
+class WrapTable
+{
+public:
+	WrapTable();
+	virtual ~WrapTable();
+
+	// Least squares fit to f(theta, values) sampled at the knots and the interval midpoints,
+	// leaving out samples that are not finite. values has 1 + num_margins + joint_ids.size()
+	// channels. Returns the largest error at the samples in each channel.
+	Eigen::VectorXd fit(MLBasisFunction::MLBasisFunctionType type,
+		const std::vector<int> &joint_ids,
+		const Eigen::VectorXd &theta_min,
+		const Eigen::VectorXd &theta_max,
+		int num_knots,
+		int num_margins,
+		const std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> &f);
+
+	// Evaluate all the channels f at the angles x, one per entry of joint_ids
+	void eval(const Eigen::VectorXd &x, Eigen::VectorXd &f);
+	// Evaluate at the current joint angles, the joints are the ones of the scene. False,
+	// without evaluating, if one of them is outside the range of the table.
+	bool update();
+
+	void setJoints(const std::vector<std::shared_ptr<Joint>> &scene_joints);
+
+	double getLength() const { return this->values(0); }
+	// Margin k, the largest one, and whether the path wraps by them
+	double getWrapMargin(int k) const { return this->values(1 + k); }
+	double getWrapMargin() const { return this->values.segment(1, this->num_margins).maxCoeff(); }
+	bool isWrapped(int k) const { return getWrapMargin(k) >= 0.0; }
+	bool isWrapped() const { return getWrapMargin() >= 0.0; }
+	Eigen::VectorXd getMomentArms() const { return this->values.tail(this->values.size() - 1 - this->num_margins); }
+	int getNumMargins() const { return this->num_margins; }
+	const std::vector<int> &getJointIds() const { return this->joint_ids; }
+	int getNumCoefficients() const { return (int)this->coeffs.size(); }
+
+	nlohmann::json toJson() const;
+	void fromJson(const nlohmann::json &j);
+
+private:
+	void init();
+	MLBasisFunction *newBasisFunction(const Eigen::VectorXi &k) const;
+	// Fill first and weights at u, the angles in knot units
+	void locate(const Eigen::VectorXd &u);
+
+	MLBasisFunction::MLBasisFunctionType type;
+	std::vector<int> joint_ids;		// index of each angle in the scene joints
+	Eigen::VectorXd theta_min;
+	Eigen::VectorXd theta_max;
+	int num_knots;					// per angle
+	int num_margins;				// wrap margins after the length channel
+	Eigen::MatrixXd coeffs;			// num_channels x num_basis, angle 0 varies fastest
+
+	// Derived from the above by init()
+	int width;						// basis functions nonzero on one interval, per angle
+	int offset;						// knot index of the center of basis function 0, negated
+	double support;					// half-width of a basis function in knot intervals
+	int num_basis;					// per angle
+	Eigen::VectorXd spacing;
+	Eigen::VectorXi strides;
+
+	// Runtime workspace
+	std::vector<std::shared_ptr<Joint>> joints;
+	Eigen::VectorXd theta;
+	Eigen::VectorXd u;				// theta in knot units
+	Eigen::VectorXd values;
+	Eigen::VectorXi first;			// first nonzero basis function per angle
+	Eigen::MatrixXd weights;		// width x angles
+	Eigen::VectorXi corner;			// position in the width^d block of nonzero functions
+};
+
+#endif // MUSCLEMASS_SRC_WRAPTABLE_H_